@@ -12,6 +12,8 @@
 // Required headers
 
 #include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
 
 // ---------------------------------------------------------------------------
 // Definitions
@@ -36,22 +38,50 @@
 #define dynU32 unsigned int
 #endif
 
+#ifndef dynU64
+#define dynU64 unsigned long long
+#endif
+
 #ifndef dynF32
 #define dynF32 float
 #endif
 
+// Define DYN_64BIT_SIZES to let arrays, strings and maps grow past 2GB. dynSize stays signed
+// (negative indices mean "the end" in a few places), so it becomes a long long.
 #ifndef dynSize
+#if DYN_64BIT_SIZES
+#define dynSize long long
+#else
 #define dynSize int
 #endif
+#endif
 
 #ifndef dynSizeFormat
+#if DYN_64BIT_SIZES
+#define dynSizeFormat "%lld"
+#else
 #define dynSizeFormat "%d"
 #endif
+#endif
+
+#ifndef dynSizeMax
+#if DYN_64BIT_SIZES
+#define dynSizeMax 0x7fffffffffffffffLL
+#else
+#define dynSizeMax 0x7fffffff
+#endif
+#endif
 
 #ifndef dynMapHash
 #define dynMapHash unsigned int // output from djb2hash
 #endif
 
+#if defined(_MSC_VER)
+#define DYN_INLINE static __inline
+#else
+#define DYN_INLINE static inline
+#endif
+
 #if !DYN_USE_MURMUR3 && !DYN_USE_DJB2
 #define DYN_USE_MURMUR3 1
 //#define DYN_USE_DJB2 1
@@ -64,21 +94,57 @@
 typedef void (*dynDestroyFunc)(void *p);
 typedef void (*dynDestroyFuncP1)(void *p1, void *p);
 typedef void (*dynDestroyFuncP2)(void *p1, void *p2, void *p);
+// Batched: gets count contiguous elements at once (for arrays of pointers, elements is a void **)
+typedef void (*dynDestroyBatchFunc)(void *elements, dynSize count);
+typedef int (*dynPredicateFunc)(void *element, void *userData); // element points at the value
+
+// qsort-style comparison: negative, zero or positive as a sorts before, with or after b
+typedef int (*dynCompareFunc)(const void *a, const void *b);
 
 // ---------------------------------------------------------------------------
 // Array
 
 // creation / destruction / cleanup
 void daCreate(void *daptr, dynSize elementSize); // use elementSize=0 for "pointer sized"
+// Deque arrays are ring buffers: shift/unshift/push/pop are all O(1), but elements may wrap around
+// the end of the storage, so index them with daAt() (or call daLinearize() first) instead of (*daptr)[i].
+void daCreateDeque(void *daptr, dynSize elementSize);
+
+// Builds the array inside caller-owned memory (a stack buffer, a struct member...) so it doesn't touch
+// malloc until it outgrows it; after that it moves to the heap like any other array. daDestroy() is
+// still required, and the storage must outlive the array. Size it with dynArrayStorageSize().
+void daCreateWithStorage(void *daptr, dynSize elementSize, void *storage, size_t storageBytes);
+
+// Copy-on-write snapshots: daClone() points dst at the same storage as src in O(1) (dst's old
+// contents are dropped as if by daDestroy(dst, NULL)). Whichever handle is modified first by a
+// da*() call gets its own copy then; until that happens, handles can be read from any number of
+// threads. Copies are shallow, so clone arrays of values or of pointers owned elsewhere. Clearing
+// or destroying a shared handle just lets go of it; destroyFunc only runs for the last one.
+// Call daUnshare() before writing through (*daptr)[i] directly.
+void daClone(void *dstptr, void *srcptr);
+void daUnshare(void *daptr);
+
+// Files: daSaveFile() writes the elements behind a small fixed header (native byte order, so the
+// data is only portable between machines of the same endianness). daMapFile() replaces daptr's
+// contents with a private mapping of such a file: nothing is parsed or copied up front, and pages
+// load on first touch. Mapped arrays are read-only unless DA_MAP_WRITABLE is passed; either way
+// nothing is ever written back to the file, and the first da*() call that modifies a read-only
+// mapping (or grows a writable one) moves it to the heap. Both return 0 on failure.
+#define DA_MAP_WRITABLE (1 << 0) // copy-on-write pages: direct (*daptr)[i] writes are allowed, and stay private
+
+int daSaveFile(void *daptr, const char *path);
+int daMapFile(void *daptr, const char *path, int flags);
 void daDestroyIndirect(void *daptr, void * /*dynDestroyFunc*/ destroyFunc);
 void daDestroy(void *daptr, void * /*dynDestroyFunc*/ destroyFunc);
 void daDestroyP1(void *daptr, void * /*dynDestroyFuncP1*/ destroyFunc, void *p1);
 void daDestroyP2(void *daptr, void * /*dynDestroyFuncP2*/ destroyFunc, void *p1, void *p2);
+void daDestroyBatch(void *daptr, void * /*dynDestroyBatchFunc*/ destroyFunc); // one call per run (two for a wrapped deque)
 void daDestroyStrings(void *daptr);
 void daClearIndirect(void *daptr, void * /*dynDestroyFunc*/ destroyFunc);
 void daClear(void *daptr, void * /*dynDestroyFunc*/ destroyFunc);
 void daClearP1(void *daptr, void * /*dynDestroyFuncP1*/ destroyFunc, void *p1);
 void daClearP2(void *daptr, void * /*dynDestroyFuncP2*/ destroyFunc, void *p1, void *p2);
+void daClearBatch(void *daptr, void * /*dynDestroyBatchFunc*/ destroyFunc);
 void daClearStrings(void *daptr);
 
 // front/back manipulation
@@ -106,18 +172,390 @@ void daInsertU16(void *daptr, dynSize index, dynU16 v);
 void daInsertU32(void *daptr, dynSize index, dynU32 v);
 void daInsertF32(void *daptr, dynSize index, dynF32 v);
 void daErase(void *daptr, dynSize index);
+void daEraseFast(void *daptr, dynSize index); // moves the last element into the hole; doesn't keep order
+
+// bulk / range manipulation (a NULL src zero-fills the new elements)
+dynSize daPushN(void *daptr, const void *src, dynSize count); // returns the index of the first new element
+void daInsertRange(void *daptr, dynSize index, const void *src, dynSize count);
+void daEraseRange(void *daptr, dynSize index, dynSize count);
+dynSize daRemoveIf(void *daptr, void * /*dynPredicateFunc*/ predicate, void *userData, void * /*dynDestroyFunc*/ destroyFunc); // keeps order, returns how many went
+void daAppendArray(void *daptr, void *srcptr); // both arrays must share an elementSize
+void daSlice(void *dstptr, void *srcptr, dynSize start, dynSize end); // dst becomes a copy of src[start, end); end < 0 means "to the end"
+
+void *daAt(void *daptr, dynSize index); // address of element [index] (deque-safe), NULL if out of range
+void daLinearize(void *daptr);          // makes a deque directly indexable until its next shift/unshift
 
 // Size manipulation
 void daSetSize(void *daptr, dynSize newSize, void * /*dynDestroyFunc*/ destroyFunc);
 void daSetSizeP1(void *daptr, dynSize newSize, void * /*dynDestroyFuncP1*/ destroyFunc, void *p1);
 void daSetSizeP2(void *daptr, dynSize newSize, void * /*dynDestroyFuncP2*/ destroyFunc, void *p1, void *p2);
+void daReserveUninit(void *daptr, dynSize newSize); // daSetSize() that leaves new elements uninitialized
+void *daPushUninit(void *daptr, dynSize count);     // appends count uninitialized elements, returns the first
 dynSize daSize(void *daptr);
 void daSetCapacity(void *daptr, dynSize newCapacity, void * /*dynDestroyFunc*/ destroyFunc);
 void daSetCapacityP1(void *daptr, dynSize newCapacity, void * /*dynDestroyFuncP1*/ destroyFunc, void *p1);
 void daSetCapacityP2(void *daptr, dynSize newCapacity, void * /*dynDestroyFuncP2*/ destroyFunc, void *p1, void *p2);
+void daShrinkToFit(void *daptr); // capacity = size (no-op for caller storage and mapped arrays)
+
+// How an array's capacity grows when it runs out of room. The policy sticks with the array
+// through clears, copies and clones.
+#define DA_GROW_DOUBLE 0 // 2x (the default): the fewest reallocations
+#define DA_GROW_HALF   1 // 1.5x: less slack, and blocks freed along the way can be reused
+#define DA_GROW_CHUNK  2 // a fixed chunkSize elements at a time, for arrays that grow steadily
+#define DA_GROW_PAGES  3 // 2x up to 2MB, then 1.25x rounded up to whole 2MB (huge) pages
+void daSetGrowth(void *daptr, int policy, dynSize chunkSize); // chunkSize is only used by DA_GROW_CHUNK
+
+// With auto-shrink on, anything that removes elements (pops, erases, clears, daSetSize...) hands
+// memory back once the array is down to a quarter of its capacity, shrinking it to twice its size.
+void daSetAutoShrink(void *daptr, int enabled);
 dynSize daCapacity(void *daptr);
 void daSquash(void *daptr);
 
+// Sorting / searching (these linearize deque arrays)
+void daSort(void *daptr, void * /*dynCompareFunc*/ compareFunc);       // introsort, not stable
+void daStableSort(void *daptr, void * /*dynCompareFunc*/ compareFunc); // merge sort, keeps equal elements in order
+void daParallelSort(void *daptr, void * /*dynCompareFunc*/ compareFunc); // daSort() across dtDefaultPool(), not stable
+void daSortU8(void *daptr);  // radix sorts for arrays built with the matching daPush*() family
+void daSortU16(void *daptr);
+void daSortU32(void *daptr);
+void daSortF32(void *daptr);
+dynSize daLowerBound(void *daptr, const void *key, void * /*dynCompareFunc*/ compareFunc); // first element >= key
+dynSize daUpperBound(void *daptr, const void *key, void * /*dynCompareFunc*/ compareFunc); // first element > key
+dynSize daBinarySearch(void *daptr, const void *key, void * /*dynCompareFunc*/ compareFunc); // index of a match, or -1
+
+// Heaps / priority queues (4-ary min-heaps: index 0 is the smallest element per compareFunc)
+void daHeapify(void *daptr, void * /*dynCompareFunc*/ compareFunc);
+void daHeapPush(void *daptr, const void *element, void * /*dynCompareFunc*/ compareFunc);
+int daHeapPop(void *daptr, void *out, void * /*dynCompareFunc*/ compareFunc); // out may be NULL; returns 0 if empty
+int daHeapPushBounded(void *daptr, const void *element, dynSize maxSize, void * /*dynCompareFunc*/ compareFunc); // keeps the maxSize largest; returns 0 if rejected
+void daTopK(void *dstptr, void *srcptr, dynSize k, void * /*dynCompareFunc*/ compareFunc); // dst = src's k largest, largest first
+void daHeapifyU32(void *daptr);  // numeric keys in their natural order, for arrays built with daPushU32/F32
+void daHeapPushU32(void *daptr, dynU32 value);
+int daHeapPopU32(void *daptr, dynU32 *out);
+int daHeapPushBoundedU32(void *daptr, dynU32 value, dynSize maxSize);
+void daHeapifyF32(void *daptr);
+void daHeapPushF32(void *daptr, dynF32 value);
+int daHeapPopF32(void *daptr, dynF32 *out);
+int daHeapPushBoundedF32(void *daptr, dynF32 value, dynSize maxSize);
+
+// Numeric kernels for arrays built with the matching daPush*() family (others are left alone / yield 0).
+// These use SSE2 or AVX2 when the CPU has them, so float results can differ from a plain loop's in the last bits.
+dynF32 daSumF32(void *daptr);
+dynU64 daSumU32(void *daptr);                 // widened, so it can't wrap
+dynF32 daDotF32(void *daptr, void *otherptr); // over the shorter of the two arrays
+int daMinMaxU32(void *daptr, dynU32 *minValue, dynU32 *maxValue); // returns 0 if the array is empty
+int daMinMaxF32(void *daptr, dynF32 *minValue, dynF32 *maxValue); // (NaNs give unspecified results)
+void daScaleF32(void *daptr, dynF32 scale);
+void daPrefixSumU32(void *daptr);             // inclusive running total, in place (wraps like dynU32 math)
+
+// Array header (lives immediately before the values); exposed only for the inline fast paths below
+
+typedef struct dynArray
+{
+    dynSize size;
+    dynSize capacity;
+    dynSize elementSize;
+    dynSize head;  // physical index of element 0 (always 0 unless DAF_DEQUE)
+    int flags;
+    int growStep;   // DA_GROW_CHUNK's chunk size, in elements
+    long long refs; // other handles sharing this block (DAF_SHARED); updated atomically
+} dynArray;
+
+#define DAF_DEQUE    (1 << 0) // storage is a ring buffer starting at 'head'
+#define DAF_BORROWED (1 << 1) // lives in caller-provided storage; never realloc'd or freed
+#define DAF_SHARED   (1 << 2) // daClone()d; copied before the next modification
+#define DAF_MAPPED   (1 << 3) // lives in a daMapFile() mapping; unmapped instead of freed
+#define DAF_READONLY (1 << 4) // mapped read-only; copied to the heap before the next modification
+#define DAF_AUTO_SHRINK (1 << 5) // see daSetAutoShrink()
+#define DAF_GROW_SHIFT 8
+#define DAF_GROW_MASK (3 << DAF_GROW_SHIFT) // the DA_GROW_* policy
+
+#define DAF_SLOW_PUSH (DAF_DEQUE | DAF_SHARED | DAF_READONLY) // flags that keep pushes off the inline fast path
+
+// Values start this far past the header, which keeps them 16 byte aligned
+#define dynArrayHeaderSize ((sizeof(dynArray) + 15) & ~(size_t)15)
+
+// Bytes of caller storage daCreateWithStorage() needs for COUNT elements (includes alignment slack)
+#define dynArrayStorageSize(ELEMENTSIZE, COUNT) (dynArrayHeaderSize + 15 + ((size_t)(ELEMENTSIZE) * (size_t)(COUNT)))
+#define dynArrayToValues(da) ((char *)(((char *)da) + dynArrayHeaderSize))
+#define dynValuesToArray(daptr) ((dynArray *)((char *)(*daptr) - dynArrayHeaderSize))
+
+// Inline fast paths: these only fall back to the out-of-line versions when an array needs to be
+// created or grown.
+
+DYN_INLINE dynSize daSizeInline(void *daptr)
+{
+    char **values = daptr ? *(char ***)daptr : NULL;
+    return values ? dynValuesToArray(&values)->size : 0;
+}
+
+DYN_INLINE dynSize daCapacityInline(void *daptr)
+{
+    char **values = daptr ? *(char ***)daptr : NULL;
+    return values ? dynValuesToArray(&values)->capacity : 0;
+}
+
+DYN_INLINE dynSize daPushIndirectInline(void *daptr, void *entry)
+{
+    char **values = *(char ***)daptr;
+    if(values)
+    {
+        dynArray *da = dynValuesToArray(&values);
+        if((da->size < da->capacity) && !(da->flags & DAF_SLOW_PUSH))
+        {
+            memcpy((char *)values + (da->size * da->elementSize), entry, da->elementSize);
+            return da->size++;
+        }
+    }
+    return (daPushIndirect)(daptr, entry);
+}
+
+#define DYN_PUSH_INLINE(SUFFIX, TYPE)                                                          \
+    DYN_INLINE dynSize daPush ## SUFFIX ## Inline(void *daptr, TYPE v)                         \
+    {                                                                                          \
+        char **values = *(char ***)daptr;                                                      \
+        if(values)                                                                             \
+        {                                                                                      \
+            dynArray *da = dynValuesToArray(&values);                                          \
+            if((da->size < da->capacity) && (da->elementSize == sizeof(TYPE)) && !(da->flags & DAF_SLOW_PUSH)) \
+            {                                                                                  \
+                ((TYPE *)values)[da->size] = v;                                                \
+                return da->size++;                                                             \
+            }                                                                                  \
+        }                                                                                      \
+        return (daPush ## SUFFIX)(daptr, v);                                                   \
+    }
+
+DYN_PUSH_INLINE(U8, dynU8)
+DYN_PUSH_INLINE(U16, dynU16)
+DYN_PUSH_INLINE(U32, dynU32)
+DYN_PUSH_INLINE(F32, dynF32)
+
+#define daSize(DAPTR) daSizeInline(DAPTR)
+#define daCapacity(DAPTR) daCapacityInline(DAPTR)
+#define daPushIndirect(DAPTR, ENTRY) daPushIndirectInline(DAPTR, ENTRY)
+#define daPushU8(DAPTR, V) daPushU8Inline(DAPTR, V)
+#define daPushU16(DAPTR, V) daPushU16Inline(DAPTR, V)
+#define daPushU32(DAPTR, V) daPushU32Inline(DAPTR, V)
+#define daPushF32(DAPTR, V) daPushF32Inline(DAPTR, V)
+
+// ---------------------------------------------------------------------------
+// Chunked Array
+
+// Elements live in fixed-size chunks that never move, so growing never copies anything and
+// pointers to elements stay valid until they are popped or the array is cleared. Indexing is a
+// shift and a mask. Chunks hold a power of two elements; chunkSize 0 picks about 64KB per chunk.
+typedef struct dynChunkArray
+{
+    char **chunks;      // dynArray of chunk pointers
+    dynSize elementSize;
+    dynSize size;
+    dynSize chunkMask;  // chunk size - 1
+    int chunkShift;     // log2 of the chunk size
+} dynChunkArray;
+
+dynChunkArray *dcCreate(dynSize elementSize, dynSize chunkSize);
+void dcDestroy(dynChunkArray *dc, void * /*dynDestroyFunc*/ destroyFunc); // destroyFunc gets a pointer to each element
+void dcClear(dynChunkArray *dc, void * /*dynDestroyFunc*/ destroyFunc);
+void *dcPush(dynChunkArray *dc, const void *value);                 // returns the new element; a NULL value zero-fills
+dynSize dcPushN(dynChunkArray *dc, const void *src, dynSize count); // returns the index of the first new element
+void dcPop(dynChunkArray *dc, void * /*dynDestroyFunc*/ destroyFunc);
+dynSize dcSize(dynChunkArray *dc);
+void *dcAt(dynChunkArray *dc, dynSize index);                       // NULL if out of range
+dynSize dcChunkCount(dynChunkArray *dc);
+void *dcChunk(dynChunkArray *dc, dynSize chunkIndex, dynSize *count); // contiguous run of *count elements, for scans
+
+DYN_INLINE dynSize dcSizeInline(dynChunkArray *dc)
+{
+    return dc->size;
+}
+
+DYN_INLINE void *dcAtInline(dynChunkArray *dc, dynSize index)
+{
+    if((index < 0) || (index >= dc->size))
+        return NULL;
+    return dc->chunks[index >> dc->chunkShift] + ((index & dc->chunkMask) * dc->elementSize);
+}
+
+#define dcSize(DC) dcSizeInline(DC)
+#define dcAt(DC, INDEX) dcAtInline(DC, INDEX)
+
+// ---------------------------------------------------------------------------
+// Records (structure of arrays)
+
+// A table of records where every field is stored in its own contiguous dynArray ("column"), so a
+// scan over one field only touches that field's memory. Records go in and out as regular structs;
+// the schema says where each field lives inside that struct.
+typedef struct dynRecordField
+{
+    dynSize offset; // within the record struct
+    dynSize size;
+} dynRecordField;
+
+#define DYN_RECORD_FIELD(TYPE, MEMBER) { (dynSize)offsetof(TYPE, MEMBER), (dynSize)sizeof(((TYPE *)0)->MEMBER) }
+
+typedef struct dynRecords
+{
+    dynRecordField *fields;
+    char **columns;     // one dynArray per field
+    int fieldCount;
+    dynSize recordSize;
+    dynSize size;
+} dynRecords;
+
+dynRecords *drCreate(const dynRecordField *fields, int fieldCount, dynSize recordSize);
+void drDestroy(dynRecords *dr);
+void drClear(dynRecords *dr);
+void drReserve(dynRecords *dr, dynSize capacity);
+dynSize drPush(dynRecords *dr, const void *record); // returns the new record's index; a NULL record zero-fills
+int drGet(dynRecords *dr, dynSize index, void *record); // copies the fields out; returns 0 if out of range
+void drSet(dynRecords *dr, dynSize index, const void *record);
+void drErase(dynRecords *dr, dynSize index);
+dynSize drSize(dynRecords *dr);
+void *drColumn(dynRecords *dr, int fieldIndex);      // the field's values, contiguous (NULL while empty)
+void *drColumnArray(dynRecords *dr, int fieldIndex); // the column's dynArray handle, for read-only da*() calls (daSumF32, daMinMaxU32...)
+
+// ---------------------------------------------------------------------------
+// Slot Map
+
+// Stores elements densely (iterate them as a plain array) while handing out handles that stay
+// valid no matter how other elements come and go. Insert, erase and lookup are all O(1); erasing
+// moves the last element into the hole, so dense order is not insertion order. A handle carries
+// a generation, so using one after its element was erased just finds nothing.
+typedef dynU64 dynHandle;
+#define DYN_INVALID_HANDLE ((dynHandle)0) // no live element ever has this handle
+
+typedef struct dynSlotMap dynSlotMap;
+
+dynSlotMap *dhCreate(dynSize elementSize);
+void dhDestroy(dynSlotMap *sm, void * /*dynDestroyFunc*/ destroyFunc); // destroyFunc gets a pointer to each element
+void dhClear(dynSlotMap *sm, void * /*dynDestroyFunc*/ destroyFunc);   // invalidates every handle
+dynHandle dhInsert(dynSlotMap *sm, const void *value, void **element); // NULL value zero-fills; element (optional) receives its address
+int dhErase(dynSlotMap *sm, dynHandle handle, void * /*dynDestroyFunc*/ destroyFunc); // returns 0 for a stale handle
+void *dhGet(dynSlotMap *sm, dynHandle handle);   // NULL for a stale handle; valid until the next insert/erase
+dynSize dhSize(dynSlotMap *sm);
+void *dhValues(dynSlotMap *sm);                  // the dhSize() live elements, contiguous
+dynHandle dhHandleAt(dynSlotMap *sm, dynSize denseIndex); // handle of dhValues()[denseIndex]
+
+// ---------------------------------------------------------------------------
+// Object Pool
+
+// A free-list allocator for lots of same-sized objects, carved out of big blocks. dpFree() is
+// O(1) and never returns memory to the system; dpClear()/dpDestroy() drop every object at once,
+// so arrays of pooled pointers don't need a destroyFunc at all. To hand back a whole array of
+// them early, use dpFreeN(pool, (void **)objects, daSize(&objects)).
+typedef struct dynPool dynPool;
+
+dynPool *dpCreate(dynSize objectSize, dynSize objectsPerBlock); // 0 objectsPerBlock picks ~64KB blocks
+void dpDestroy(dynPool *pool); // frees every object, live or not
+void dpClear(dynPool *pool);   // same, but keeps the pool (and one block) for reuse
+void *dpAlloc(dynPool *pool);  // uninitialized, aligned to 8 (16 for objects of 16+ bytes)
+void *dpCalloc(dynPool *pool); // zeroed
+void dpFree(dynPool *pool, void *p);
+void dpAllocN(dynPool *pool, void **objects, dynSize count);
+void dpFreeN(dynPool *pool, void **objects, dynSize count);
+dynSize dpLiveCount(dynPool *pool);
+
+// ---------------------------------------------------------------------------
+// Bitset
+
+// A resizable run of bits, 64 to a word. Counting and the whole-set operations go 128 or 256 bits
+// at a time with SSE2/AVX2 when the CPU has them. Sets of different lengths can be combined; the
+// shorter one's missing bits count as 0, and dst never changes length.
+typedef struct dynBitset
+{
+    dynU64 *words;    // dynArray; bits past bitCount are always 0
+    dynSize bitCount;
+} dynBitset;
+
+dynBitset *dbCreate(dynSize bitCount); // every bit starts cleared
+void dbDestroy(dynBitset *bs);
+void dbResize(dynBitset *bs, dynSize bitCount); // new bits are cleared
+void dbClearAll(dynBitset *bs);
+void dbSetAll(dynBitset *bs);
+void dbSet(dynBitset *bs, dynSize index);   // out of range indices are ignored
+void dbReset(dynBitset *bs, dynSize index);
+int dbTest(dynBitset *bs, dynSize index);   // 0 if out of range
+dynSize dbNextSet(dynBitset *bs, dynSize start); // first set bit at or after start, or -1
+dynSize dbCount(dynBitset *bs);                  // number of set bits
+dynSize dbAndCount(dynBitset *a, dynBitset *b);  // dbCount(a & b), without building a & b
+void dbAnd(dynBitset *dst, dynBitset *src);      // dst &= src
+void dbOr(dynBitset *dst, dynBitset *src);       // dst |= src
+void dbAndNot(dynBitset *dst, dynBitset *src);   // dst &= ~src
+void dbXor(dynBitset *dst, dynBitset *src);      // dst ^= src
+
+DYN_INLINE void dbSetInline(dynBitset *bs, dynSize index)
+{
+    if((index >= 0) && (index < bs->bitCount))
+        bs->words[index >> 6] |= ((dynU64)1) << (index & 63);
+}
+
+DYN_INLINE void dbResetInline(dynBitset *bs, dynSize index)
+{
+    if((index >= 0) && (index < bs->bitCount))
+        bs->words[index >> 6] &= ~(((dynU64)1) << (index & 63));
+}
+
+DYN_INLINE int dbTestInline(dynBitset *bs, dynSize index)
+{
+    if((index < 0) || (index >= bs->bitCount))
+        return 0;
+    return (int)((bs->words[index >> 6] >> (index & 63)) & 1);
+}
+
+#define dbSet(BS, INDEX) dbSetInline(BS, INDEX)
+#define dbReset(BS, INDEX) dbResetInline(BS, INDEX)
+#define dbTest(BS, INDEX) dbTestInline(BS, INDEX)
+
+// ---------------------------------------------------------------------------
+// Packed Integer Array
+
+// An append-only sequence of dynU32s, stored bit-packed in blocks of DZ_BLOCK_SIZE values where
+// every value in a block gets just as many bits as the block's largest one needs. With DZF_DELTA,
+// the differences between neighbors are packed instead, which suits sorted or slowly changing data
+// (ids, offsets, timestamps). Blocks are unpacked (and delta decoded) four values per instruction
+// with SSE2. Reading is sequential: walk a dynPackedIter, or dzDecode() everything at once.
+#define DZF_DELTA (1 << 0)
+
+#define DZ_BLOCK_SIZE 128
+
+typedef struct dynPackedArray dynPackedArray;
+
+typedef struct dynPackedIter
+{
+    dynPackedArray *pa;
+    dynSize word;                  // next block to unpack
+    dynSize pos;                   // next value to hand out of values
+    dynSize count;                 // values currently unpacked into values
+    int tailDone;
+    dynU32 last[4];                // DZF_DELTA running values
+    dynU32 values[DZ_BLOCK_SIZE];
+} dynPackedIter;
+
+dynPackedArray *dzCreate(int flags);
+void dzDestroy(dynPackedArray *pa);
+void dzClear(dynPackedArray *pa);
+void dzAppend(dynPackedArray *pa, dynU32 value);
+void dzAppendN(dynPackedArray *pa, const dynU32 *values, dynSize count);
+dynSize dzSize(dynPackedArray *pa);
+dynSize dzBytes(dynPackedArray *pa);            // encoded size (not counting the fixed overhead)
+void dzDecode(dynPackedArray *pa, void *daptr); // replaces daptr's contents with every value (daPushU32-style array)
+
+// Iteration: appending while iterating is not supported
+void dzIterBegin(dynPackedIter *iter, dynPackedArray *pa);
+int dzIterNext(dynPackedIter *iter, dynU32 *value);  // returns 0 when there are no more values
+dynSize dzIterNextBlock(dynPackedIter *iter);        // unpacks the next run into iter->values; returns its length (0 at the end)
+
+DYN_INLINE int dzIterNextInline(dynPackedIter *iter, dynU32 *value)
+{
+    if((iter->pos >= iter->count) && (dzIterNextBlock(iter) == 0))
+        return 0;
+    *value = iter->values[iter->pos++];
+    return 1;
+}
+
+#define dzIterNext(ITER, VALUE) dzIterNextInline(ITER, VALUE)
+
 // ---------------------------------------------------------------------------
 // Map
 
@@ -139,6 +577,7 @@ typedef struct dynMapEntry
     };
     struct dynMapEntry *next;
     dynMapHash hash;
+    dynSize slab; // 0, or 1 + the serial of the dmCompact() slab holding the entry (and its owned key)
     // data is immediately following every entry's allocated block
 } dynMapEntry;
 
@@ -159,7 +598,13 @@ typedef struct dynMap
     dynSize mod;         // pre-split modulus (use mod*2 for overflow)
     dynSize elementSize;
     int flags;
-    int count;           // count tracking for convenience
+    dynSize count;       // count tracking for convenience
+    struct dynMapSlab **slabs; // dynArray of dmCompact() slabs, NULL once empty (until they reach the front)
+    dynSize slabBase;          // serial of slabs[0]; every slab's serial is its index plus this
+    dynSize compactCursor;     // next bucket to relocate in an in-progress compaction
+    dynSize compactFirstSlab;  // serial of the first slab filled by the in-progress compaction
+    int compacting;
+    int hashShift;             // low hash bits ignored when bucketing (dmParallelBuild's sub-maps)
 } dynMap;
 
 dynMap *dmCreate(dmKeyFlags flags, dynSize elementSize);
@@ -167,6 +612,14 @@ void dmDestroyIndirect(dynMap *dm, void * /*dynDestroyFunc*/ destroyFunc);
 void dmDestroy(dynMap *dm, void * /*dynDestroyFunc*/ destroyFunc);
 void dmClearIndirect(dynMap *dm, void * /*dynDestroyFunc*/ destroyFunc);
 void dmClear(dynMap *dm, void * /*dynDestroyFunc*/ destroyFunc);
+// Batched teardown: entries aren't contiguous, so destroyFunc gets up to DM_DESTROY_BATCH pointers
+// at a time, gathered into a (void **) array. dmClearBatch() passes the stored pointers themselves
+// (like dmClear), dmClearBatchIndirect() passes a pointer to each entry's data.
+#define DM_DESTROY_BATCH 256
+void dmDestroyBatch(dynMap *dm, void * /*dynDestroyBatchFunc*/ destroyFunc);
+void dmDestroyBatchIndirect(dynMap *dm, void * /*dynDestroyBatchFunc*/ destroyFunc);
+void dmClearBatch(dynMap *dm, void * /*dynDestroyBatchFunc*/ destroyFunc);
+void dmClearBatchIndirect(dynMap *dm, void * /*dynDestroyBatchFunc*/ destroyFunc);
 
 dynMapEntry *dmGetString(dynMap *dm, const char *key);
 int dmHasString(dynMap *dm, const char *key);
@@ -182,6 +635,34 @@ void *dmEntryData(dynMapEntry *entry);
 typedef int (*dynMapIterateFunc)(dynMap *dm, dynMapEntry *e, void *userData);
 void dmIterate(dynMap *dm, /* dynMapIterateFunc */ void *func, void *userData);
 
+// Compaction
+
+// Relocates every entry (and owned string key) into contiguous memory in bucket order, so chains
+// and dmIterate() walk memory front to back. Entry pointers handed out earlier become invalid.
+void dmCompact(dynMap *dm);
+
+// Incremental dmCompact(): relocates roughly maxEntries entries (whole buckets at a time) per call,
+// and returns non-zero once a pass over the table is complete. The map can be used (and modified)
+// freely between steps.
+int dmCompactStep(dynMap *dm, dynSize maxEntries);
+
+// Parallel building / merging
+
+// Called once per key (in key order for repeated keys) to fill in a freshly built entry's data.
+// Runs on worker threads, so it must only touch the entry it is handed and its own userData.
+typedef void (*dynMapBuildFunc)(dynMapEntry *e, dynSize keyIndex, void *userData);
+
+// keys is a (const char **) for DKF_STRING maps, or a (const dynInt *) for DKF_INTEGER maps.
+// Keys are partitioned by hash across threadCount threads (0 = one per CPU).
+dynMap *dmParallelBuild(dmKeyFlags flags, dynSize elementSize, const void *keys, dynSize keyCount, void * /*dynMapBuildFunc*/ func, void *userData, int threadCount);
+
+// Called for every key present in both maps; fold srcEntry's data into dstEntry's.
+typedef void (*dynMapMergeFunc)(dynMap *dst, dynMapEntry *dstEntry, dynMapEntry *srcEntry, void *userData);
+
+// Adds every entry of src to dst (src is left untouched). Keys missing from dst get a shallow copy
+// of src's data; keys in both are handed to func, or simply overwritten if func is NULL.
+void dmMerge(dynMap *dst, dynMap *src, void * /*dynMapMergeFunc*/ func, void *userData);
+
 // Convenience macros
 
 // "to string/integer pointers"
@@ -210,6 +691,11 @@ void dsClear(char **dsptr);
 char *dsDup(const char *text);
 char *dsDupf(const char *format, ...);
 
+// Builds the string inside caller-owned memory (see daCreateWithStorage()): no malloc until the text
+// outgrows it. dsDestroy() is still required, and the storage must outlive the string. Size it with
+// dynStringStorageSize().
+void dsCreateWithStorage(char **dsptr, void *storage, size_t storageBytes);
+
 // manipulation
 void dsCopyLen(char **dsptr, const char *text, dynSize len);
 void dsCopy(char **dsptr, const char *text);
@@ -221,12 +707,118 @@ void dsConcatf(char **dsptr, const char *format, ...);
 void dsSetLength(char **dsptr, dynSize newLength);
 void dsCalcLength(char **dsptr);
 void dsSetCapacity(char **dsptr, dynSize newCapacity);
+void dsReserve(char **dsptr, dynSize capacity); // grows (never shrinks) capacity up front; appends also grow geometrically
+void dsShrinkToFit(char **dsptr);                // capacity = length
 
 // information / testing
 int dsCmp(char **dsptr, char **other);
 dynSize dsLength(char **dsptr);
 dynSize dsCapacity(char **dsptr);
 
+// String header (lives immediately before the characters); exposed only for the inline fast paths below.
+// As in sds, the header is sized by the capacity: length and capacity are stored as unsigned 8, 16,
+// 32 or 64 bit values, followed by a flags byte (str[-1]) whose low bits say which. A string under
+// 256 chars carries 3 bytes of header. The empty string made by dsCreate()/dsClear() on a NULL ptr
+// is a shared static one, so it costs no allocation at all.
+#define DSH_8 0
+#define DSH_16 1
+#define DSH_32 2
+#define DSH_64 3
+#define DSH_TYPE_MASK 3
+#define DSF_STORAGE (1 << 2) // lives in caller-provided storage; never realloc'd or freed
+#define DSF_STATIC (1 << 3)  // the shared empty string; replaced (not written) on first change
+
+#define dynStringHeaderSize(TYPE) ((2 * ((size_t)1 << (TYPE))) + 1)
+#define dynStringStorageSize(CHARS) ((size_t)(CHARS) + 1 + dynStringHeaderSize(((CHARS) < 256) ? DSH_8 : (((CHARS) < 65536) ? DSH_16 : (((unsigned long long)(CHARS) < 0x100000000ULL) ? DSH_32 : DSH_64))))
+
+// field 0 is the length, 1 the capacity; each is (1 << type) bytes wide and may be unaligned
+DYN_INLINE dynSize dsHeaderField(const char *str, int field)
+{
+    const unsigned char *flags = (const unsigned char *)str - 1;
+    switch(*flags & DSH_TYPE_MASK)
+    {
+        case DSH_8:
+            return (dynSize)flags[field - 2];
+        case DSH_16:
+        {
+            dynU16 v;
+            memcpy(&v, flags - ((2 - field) * sizeof(v)), sizeof(v));
+            return (dynSize)v;
+        }
+        case DSH_32:
+        {
+            dynU32 v;
+            memcpy(&v, flags - ((2 - field) * sizeof(v)), sizeof(v));
+            return (dynSize)v;
+        }
+    }
+    {
+        dynU64 v;
+        memcpy(&v, flags - ((2 - field) * sizeof(v)), sizeof(v));
+        return (dynSize)v;
+    }
+}
+
+DYN_INLINE dynSize dsLengthInline(char **dsptr)
+{
+    return (dsptr && *dsptr) ? dsHeaderField(*dsptr, 0) : 0;
+}
+
+DYN_INLINE dynSize dsCapacityInline(char **dsptr)
+{
+    return (dsptr && *dsptr) ? dsHeaderField(*dsptr, 1) : 0;
+}
+
+#define dsLength(DSPTR) dsLengthInline(DSPTR)
+#define dsCapacity(DSPTR) dsCapacityInline(DSPTR)
+
+// ---------------------------------------------------------------------------
+// Threads
+
+typedef void (*dynThreadFunc)(int threadIndex, void *userData);
+
+int dtCPUCount(void);
+
+// Calls func(i, userData) for every i in [0, threadCount) concurrently, and returns when all
+// of them are finished. Index 0 runs on the calling thread.
+void dtRun(int threadCount, void * /*dynThreadFunc*/ func, void *userData);
+void dtYield(void); // gives up the rest of this thread's timeslice (for polling loops, e.g. on a dynQueue)
+
+// Thread pools keep their threads parked between runs, so repeated parallel work doesn't pay for
+// thread creation every time. threadCount includes the caller of dtPoolRun(); 0 means one per CPU.
+typedef struct dynThreadPool dynThreadPool;
+dynThreadPool *dtPoolCreate(int threadCount);
+void dtPoolDestroy(dynThreadPool *pool);
+int dtPoolThreadCount(dynThreadPool *pool);
+void dtPoolRun(dynThreadPool *pool, void * /*dynThreadFunc*/ func, void *userData); // same contract as dtRun()
+dynThreadPool *dtDefaultPool(void); // created on first use (sized by $DYN_THREAD_COUNT if set), lives until exit
+
+// Splits [0, daSize) into grainSize chunks and calls func(daptr, start, end, userData) for each
+// on dtDefaultPool(); idle threads steal chunks from busy ones. func must not resize the array.
+typedef void (*dynParallelForFunc)(void *daptr, dynSize start, dynSize end, void *userData);
+void daParallelFor(void *daptr, void * /*dynParallelForFunc*/ func, void *userData, dynSize grainSize);
+
+// ---------------------------------------------------------------------------
+// Queues
+
+// Bounded lock-free FIFOs for handing elements between threads. Storage is a dynArray of
+// elementSize elements, rounded up to a power of two. By default a queue is single producer /
+// single consumer (exactly one thread pushing and one popping); DQF_MPMC allows any number of each.
+// Nothing blocks: pushes into a full queue and pops from an empty one just report 0.
+#define DQF_SPSC 0
+#define DQF_MPMC (1 << 0)
+
+typedef struct dynQueue dynQueue;
+
+dynQueue *dqCreate(dynSize elementSize, dynSize capacity, int flags);
+void dqDestroy(dynQueue *dq); // no other thread may be using it
+int dqPush(dynQueue *dq, const void *element);                // returns 0 if full
+int dqPop(dynQueue *dq, void *out);                           // returns 0 if empty
+dynSize dqPushN(dynQueue *dq, const void *src, dynSize count); // pushes what fits, returns how many
+dynSize dqPopN(dynQueue *dq, void *dst, dynSize maxCount);     // returns how many were popped
+dynSize dqSize(dynQueue *dq);                                 // a snapshot; may be stale immediately
+dynSize dqCapacity(dynQueue *dq);
+
 // ---------------------------------------------------------------------------
 // JSON
 
@@ -6,31 +6,59 @@
 // ---------------------------------------------------------------------------
 
 #include "dyn.h"
+#include "dynAtomic.h"
+#include "dynFile.h"
+#include "dynSlots.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define DYN_SSE2 1 // baseline on every x64 target, so no runtime dispatch needed here
+#include <emmintrin.h>
+#endif
 
 // ------------------------------------------------------------------------------------------------
 // Constants and Macros
 
 #define DYNAMIC_ARRAY_INITIAL_SIZE 2
 
-#define dynArrayToValues(da) (char *)(((char *)da) + sizeof(dynArray))
-#define dynValuesToArray(daptr) (dynArray *)((char *)(*daptr) - sizeof(dynArray))
+#define HUGE_GROWTH_BYTES (2 * 1024 * 1024) // DA_GROW_PAGES: past this, grow in whole huge pages
 
-// ------------------------------------------------------------------------------------------------
-// Internal structures
+// dynArray itself and its header macros live in dyn.h, for the inline fast paths
 
-typedef struct dynArray
-{
-    dynSize size;
-    dynSize capacity;
-    dynSize elementSize;
-} dynArray;
+#define daRefs(DA) ((dynAtomic64 *)&(DA)->refs)
+
+#define DAF_FOREIGN (DAF_BORROWED | DAF_MAPPED) // storage dyn didn't malloc, so it can't realloc it
+#define DAF_SETTINGS (DAF_DEQUE | DAF_GROW_MASK | DAF_AUTO_SHRINK) // chosen by the caller; survive clears and copies
 
 // ------------------------------------------------------------------------------------------------
 // Internal helper functions
 
+// Bytes needed to hold a dynArray of the given capacity. Every byte offset into an array is
+// computed in dynSize arithmetic, so an array that doesn't fit in one is fatal instead of
+// silently wrapping around.
+static size_t daAllocSize(dynSize elementSize, dynSize capacity)
+{
+    unsigned long long bytes;
+    if((capacity < 0) || ((capacity > 0) && (elementSize > ((dynSizeMax - (dynSize)dynArrayHeaderSize) / capacity))))
+        abort();
+    bytes = (unsigned long long)dynArrayHeaderSize + ((unsigned long long)elementSize * (unsigned long long)capacity);
+    if(bytes > (unsigned long long)SIZE_MAX)
+        abort();
+    return (size_t)bytes;
+}
+
+// releases an array's block, unless it lives in caller-provided storage
+static void daFree(dynArray *da)
+{
+    if(da->flags & DAF_MAPPED)
+        dynFileUnmap(da);
+    else if(!(da->flags & DAF_BORROWED))
+        free(da);
+}
+
 // workhorse function that does all of the allocation and copying
 static dynArray *daChangeCapacity(dynSize newCapacity, dynSize elementSize, char ***prevptr)
 {
@@ -43,6 +71,13 @@ static dynArray *daChangeCapacity(dynSize newCapacity, dynSize elementSize, char
         elementSize = prevArray->elementSize;
         if(newCapacity == prevArray->capacity)
             return prevArray;
+        if((prevArray->flags & DAF_FOREIGN) && (prevArray->head == 0) && (newCapacity < prevArray->capacity))
+        {
+            // Caller-provided (or mapped) storage never shrinks; just drop what no longer fits
+            if(prevArray->size > newCapacity)
+                prevArray->size = newCapacity;
+            return prevArray;
+        }
     }
 
     if(elementSize == 0)
@@ -51,7 +86,21 @@ static dynArray *daChangeCapacity(dynSize newCapacity, dynSize elementSize, char
         elementSize = sizeof(char*);
     }
 
-    newArray = (dynArray *)calloc(1, sizeof(dynArray) + (elementSize * newCapacity));
+    if(prevArray && (prevArray->head == 0) && !(prevArray->flags & DAF_FOREIGN))
+    {
+        // Nothing needs rearranging, so let realloc grow in place if it can (glibc moves huge
+        // blocks with mremap, so even multi-GB arrays never get copied byte by byte).
+        newArray = (dynArray *)realloc(prevArray, daAllocSize(elementSize, newCapacity));
+        newArray->capacity = newCapacity;
+        if(newArray->size > newCapacity)
+            newArray->size = newCapacity;
+        *prevptr = (char **)dynArrayToValues(newArray);
+        return newArray;
+    }
+
+    // New storage is deliberately left uninitialized; daChangeSize() zeroes what it exposes
+    newArray = (dynArray *)malloc(daAllocSize(elementSize, newCapacity));
+    memset(newArray, 0, dynArrayHeaderSize);
     newArray->elementSize = elementSize;
     newArray->capacity = newCapacity;
     newValues = dynArrayToValues(newArray);
@@ -59,13 +108,20 @@ static dynArray *daChangeCapacity(dynSize newCapacity, dynSize elementSize, char
     {
         if(prevArray)
         {
+            // A wrapped deque gets unrolled into the new block
             char *prevValues = dynArrayToValues(prevArray);
-            int copyCount = prevArray->size;
+            dynSize copyCount = prevArray->size;
+            dynSize firstCount = prevArray->capacity - prevArray->head; // elements before the wrap
             if(copyCount > newArray->capacity)
                 copyCount = newArray->capacity;
-            memcpy(newValues, prevValues, elementSize * copyCount);
+            if(firstCount > copyCount)
+                firstCount = copyCount;
+            memcpy(newValues, prevValues + (elementSize * prevArray->head), elementSize * firstCount);
+            memcpy(newValues + (elementSize * firstCount), prevValues, elementSize * (copyCount - firstCount));
             newArray->size = copyCount;
-            free(prevArray);
+            newArray->flags = prevArray->flags & ~(DAF_FOREIGN | DAF_READONLY); // spilled onto the heap for good
+            newArray->growStep = prevArray->growStep;
+            daFree(prevArray);
         }
         *prevptr = (char **)newValues;
     }
@@ -92,10 +148,199 @@ static dynArray *daGet(char ***daptr, dynSize elementSize, int autoCreate)
     return da;
 }
 
+// Drops one handle's reference to a shared block. Returns 1 if other handles still use it, or 0
+// if the caller turned out to be the last one and now owns it outright.
+static int daReleaseShared(dynArray *da)
+{
+    if(dynAtomicAdd64(daRefs(da), -1) > 0)
+        return 1;
+    dynAtomicStore64(daRefs(da), 0);
+    da->flags &= ~DAF_SHARED;
+    return 0;
+}
+
+// Copy-on-write: gives the handle its own heap copy of a block it can't modify in place (one
+// still shared with other handles, or a read-only mapping). Neither kind ever gets rotated
+// (daClone() linearizes first, and mapped arrays start out linear), so the copy is one memcpy.
+static dynArray *daUnshareBlock(char ***daptr, dynArray *da)
+{
+    dynArray *copy;
+    int shared = 0;
+    if(da->flags & DAF_SHARED)
+    {
+        if(dynAtomicLoadAcquire64(daRefs(da)) == 0)
+            da->flags &= ~DAF_SHARED; // every other handle has let go already
+        else
+            shared = 1;
+    }
+    if(!shared && !(da->flags & DAF_READONLY))
+        return da;
+
+    copy = (dynArray *)malloc(daAllocSize(da->elementSize, da->capacity));
+    memcpy(copy, da, offsetof(dynArray, refs)); // refs is only ever touched atomically
+    memcpy(dynArrayToValues(copy), dynArrayToValues(da), (size_t)da->size * da->elementSize);
+    copy->flags &= ~(DAF_SHARED | DAF_FOREIGN | DAF_READONLY);
+    copy->refs = 0;
+    if(!shared || !daReleaseShared(da))
+        daFree(da); // nobody else is using it (anymore)
+    *daptr = (char **)dynArrayToValues(copy);
+    return copy;
+}
+
+// daGet() for anything about to modify the array
+static dynArray *daGetMutable(char ***daptr, dynSize elementSize, int autoCreate)
+{
+    dynArray *da = daGet(daptr, elementSize, autoCreate);
+    if(da && (da->flags & (DAF_SHARED | DAF_READONLY)))
+        da = daUnshareBlock(daptr, da);
+    return da;
+}
+
+// Clearing or destroying a shared block just lets go of it (the elements stay alive for the other
+// handles) and leaves the handle NULL. Returns 1 if that happened.
+static int daDropShared(char ***daptr, dynArray *da)
+{
+    if(!(da->flags & DAF_SHARED) || !daReleaseShared(da))
+        return 0;
+    *daptr = NULL;
+    return 1;
+}
+
+// non-zero if every byte of the element at p is zero
+static int daIsZeroElement(const char *p, dynSize elementSize)
+{
+    dynSize i = 0;
+#if DYN_SSE2
+    __m128i zero = _mm_setzero_si128();
+    for( ; (i + 16) <= elementSize; i += 16)
+    {
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), zero)) != 0xffff)
+            return 0;
+    }
+#endif
+    for( ; (i + 8) <= elementSize; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, p + i, 8);
+        if(word)
+            return 0;
+    }
+    for( ; i < elementSize; ++i)
+    {
+        if(p[i])
+            return 0;
+    }
+    return 1;
+}
+
+// how many elements (up to count) starting at p are non-zero, checking 16 bytes at a time
+static dynSize daNonZeroRun(const char *p, dynSize count, dynSize elementSize)
+{
+    dynSize run = 0;
+#if DYN_SSE2
+    if((elementSize == 1) || (elementSize == 2) || (elementSize == 4))
+    {
+        __m128i zero = _mm_setzero_si128();
+        dynSize perBlock = 16 / elementSize;
+        for( ; (run + perBlock) <= count; run += perBlock)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *)(p + (run * elementSize)));
+            __m128i zeros;
+            if(elementSize == 1)
+                zeros = _mm_cmpeq_epi8(x, zero);
+            else if(elementSize == 2)
+                zeros = _mm_cmpeq_epi16(x, zero);
+            else
+                zeros = _mm_cmpeq_epi32(x, zero);
+            if(_mm_movemask_epi8(zeros))
+                break; // somewhere in this block is a zero element; finish up one at a time
+        }
+    }
+#endif
+    while((run < count) && !daIsZeroElement(p + (run * elementSize), elementSize))
+        ++run;
+    return run;
+}
+
+// rotates a deque's storage so that element 0 is at the front again
+static void daRotateToFront(dynArray *da)
+{
+    char *values = dynArrayToValues(da);
+    if(da->head == 0)
+        return;
+
+    if((da->head + da->size) <= da->capacity)
+    {
+        memmove(values, values + (da->head * da->elementSize), da->size * da->elementSize);
+    }
+    else
+    {
+        dynSize firstCount = da->capacity - da->head;
+        char *temp = (char *)malloc(da->size * da->elementSize);
+        memcpy(temp, values + (da->head * da->elementSize), firstCount * da->elementSize);
+        memcpy(temp + (firstCount * da->elementSize), values, (da->size - firstCount) * da->elementSize);
+        memcpy(values, temp, da->size * da->elementSize);
+        free(temp);
+    }
+    da->head = 0;
+}
+
+// copies count elements into [index, index+count), which must already fit within the capacity.
+// A NULL src zero-fills instead.
+static void daCopyToSlots(dynArray *da, dynSize index, const char *src, dynSize count)
+{
+    char *runs[2];
+    dynSize counts[2];
+    int runCount = daRuns(da, index, count, runs, counts);
+    int i;
+    for(i = 0; i < runCount; ++i)
+    {
+        if(src)
+        {
+            memcpy(runs[i], src, counts[i] * da->elementSize);
+            src += counts[i] * da->elementSize;
+        }
+        else
+        {
+            memset(runs[i], 0, counts[i] * da->elementSize);
+        }
+    }
+}
+
+// copies count elements starting at [index] out to dst
+static void daCopyFromSlots(dynArray *da, dynSize index, char *dst, dynSize count)
+{
+    char *runs[2];
+    dynSize counts[2];
+    int runCount = daRuns(da, index, count, runs, counts);
+    int i;
+    for(i = 0; i < runCount; ++i)
+    {
+        memcpy(dst, runs[i], counts[i] * da->elementSize);
+        dst += counts[i] * da->elementSize;
+    }
+}
+
+// With DAF_AUTO_SHRINK, gives memory back once an array is down to a quarter of its capacity. It
+// only shrinks to twice the size, so popping and pushing around the threshold doesn't thrash.
+static void daAutoShrink(char ***daptr, dynArray *da)
+{
+    dynSize target;
+    if(!(da->flags & DAF_AUTO_SHRINK) || (da->flags & DAF_FOREIGN))
+        return;
+    if((da->capacity <= DYNAMIC_ARRAY_INITIAL_SIZE) || (da->size > (da->capacity / 4)))
+        return;
+    target = da->size * 2;
+    if(target < DYNAMIC_ARRAY_INITIAL_SIZE)
+        target = DYNAMIC_ARRAY_INITIAL_SIZE;
+    daChangeCapacity(target, 0, daptr);
+}
+
 // this assumes you've already destroyed any soon-to-be orphaned values at the end
-static void daChangeSize(char ***daptr, dynSize newSize)
+static void daChangeSize(char ***daptr, dynSize newSize, int zeroFill)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 1);
+    dynArray *da = daGetMutable((char ***)daptr, 0, 1);
+    daRotateToFront(da);
     if(da->size == newSize)
         return;
 
@@ -103,80 +348,134 @@ static void daChangeSize(char ***daptr, dynSize newSize)
     {
         da = daChangeCapacity(newSize, 0, daptr);
     }
-    if(newSize > da->size)
+    if(zeroFill && (newSize > da->size))
     {
         char *values = dynArrayToValues(da);
         memset(values + (da->elementSize * da->size), 0, da->elementSize * (newSize - da->size));
     }
     da->size = newSize;
+    daAutoShrink(daptr, da);
+}
+
+// The capacity an array's growth policy picks when it needs room for capacityNeeded elements
+static dynSize daNextCapacity(dynArray *da, dynSize capacityNeeded)
+{
+    int policy = (da->flags & DAF_GROW_MASK) >> DAF_GROW_SHIFT;
+    dynSize capacity = da->capacity;
+    if(capacity < 1)
+        capacity = DYNAMIC_ARRAY_INITIAL_SIZE; // multiplying zero never gets anywhere
+
+    if(policy == DA_GROW_CHUNK)
+    {
+        dynSize chunks = ((capacityNeeded - capacity) + (da->growStep - 1)) / da->growStep;
+        if((capacityNeeded <= capacity) || (chunks > ((dynSizeMax - capacity) / da->growStep)))
+            return (capacityNeeded > capacity) ? capacityNeeded : capacity;
+        return capacity + (chunks * da->growStep);
+    }
+
+    while(capacity < capacityNeeded)
+    {
+        dynSize step = capacity; // DA_GROW_DOUBLE
+        if(policy == DA_GROW_HALF)
+            step = (capacity + 1) / 2;
+        else if((policy == DA_GROW_PAGES) && (capacity > (HUGE_GROWTH_BYTES / da->elementSize)))
+            step = capacity / 4;
+        if(step > (dynSizeMax - capacity))
+            return capacityNeeded; // can't grow by that much; take exactly what's needed
+        capacity += step;
+    }
+
+    if((policy == DA_GROW_PAGES) && (capacity > (HUGE_GROWTH_BYTES / da->elementSize)))
+    {
+        // Fill the block out to a whole number of huge pages, so the allocator hands back (and
+        // realloc moves) page-aligned runs instead of leaving a ragged last page
+        unsigned long long bytes = daAllocSize(da->elementSize, capacity);
+        unsigned long long rounded = ((bytes + HUGE_GROWTH_BYTES - 1) / HUGE_GROWTH_BYTES) * HUGE_GROWTH_BYTES;
+        unsigned long long roundedCapacity = (rounded - dynArrayHeaderSize) / (unsigned long long)da->elementSize;
+        if(roundedCapacity <= (unsigned long long)dynSizeMax)
+            capacity = (dynSize)roundedCapacity;
+    }
+    return capacity;
 }
 
 // calls daChangeCapacity in preparation for new data, if necessary
-static dynArray *daMakeRoom(char ***daptr, int incomingCount)
+static dynArray *daMakeRoom(char ***daptr, dynSize incomingCount)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 1);
-    int capacityNeeded = da->size + incomingCount;
-    int newCapacity = da->capacity;
-    while(newCapacity < capacityNeeded)
-        newCapacity *= 2; // is this dumb?
-    if(newCapacity != da->capacity)
+    dynArray *da = daGetMutable((char ***)daptr, 0, 1);
+    dynSize capacityNeeded;
+    if(incomingCount > (dynSizeMax - da->size))
+        abort(); // the size itself would overflow
+    capacityNeeded = da->size + incomingCount;
+    if(capacityNeeded > da->capacity)
     {
-        da = daChangeCapacity(newCapacity, 0, daptr);
+        da = daChangeCapacity(daNextCapacity(da, capacityNeeded), 0, daptr);
     }
     return da;
 }
 
 // clears [start, (end-1)]
-static void daClearRange(dynArray *da, int start, int end, void * destroyFunc, int ptrs)
+static void daClearRange(dynArray *da, dynSize start, dynSize end, void * destroyFunc, int ptrs)
 {
     dynDestroyFunc func = destroyFunc;
     if(func)
     {
-        int i;
-        char *values = dynArrayToValues(da);
+        dynSize i;
         for(i = start; i < end; ++i)
         {
             if(ptrs)
             {
-                char **ptr = (char **)(values + (i * da->elementSize));
+                char **ptr = (char **)daSlot(da, i);
                 func(*ptr);
             }
             else
             {
-                func(values + (i * da->elementSize));
+                func(daSlot(da, i));
             }
         }
     }
 }
 
-static void daClearRangeP1(dynArray *da, int start, int end, void * destroyFunc, void *p1)
+static void daClearRangeP1(dynArray *da, dynSize start, dynSize end, void * destroyFunc, void *p1)
 {
     dynDestroyFuncP1 func = destroyFunc;
     if(func)
     {
-        int i;
-        char *values = dynArrayToValues(da);
+        dynSize i;
         for(i = start; i < end; ++i)
         {
-            func(p1, values + (i * da->elementSize));
+            func(p1, daSlot(da, i));
         }
     }
 }
 
-static void daClearRangeP2(dynArray *da, int start, int end, void * destroyFunc, void *p1, void *p2)
+static void daClearRangeP2(dynArray *da, dynSize start, dynSize end, void * destroyFunc, void *p1, void *p2)
 {
     dynDestroyFuncP2 func = destroyFunc;
     if(func)
     {
-        int i;
-        char *values = dynArrayToValues(da);
+        dynSize i;
         for(i = start; i < end; ++i)
         {
-            func(p1, p2, values + (i * da->elementSize));
+            func(p1, p2, daSlot(da, i));
         }
     }
 }
 
+// hands [start, (end-1)] to destroyFunc as contiguous runs: one call, or two if a deque wraps
+static void daClearRangeBatch(dynArray *da, dynSize start, dynSize end, void * destroyFunc)
+{
+    dynDestroyBatchFunc func = destroyFunc;
+    if(func)
+    {
+        char *runs[2];
+        dynSize counts[2];
+        int runCount = daRuns(da, start, end - start, runs, counts);
+        int i;
+        for(i = 0; i < runCount; ++i)
+            func(runs[i], counts[i]);
+    }
+}
+
 // ------------------------------------------------------------------------------------------------
 // creation / destruction / cleanup
 
@@ -185,13 +484,115 @@ void daCreate(void *daptr, dynSize elementSize)
     daGet(daptr, elementSize, 1);
 }
 
+void daCreateDeque(void *daptr, dynSize elementSize)
+{
+    dynArray *da = daGetMutable(daptr, elementSize, 1);
+    da->flags |= DAF_DEQUE;
+}
+
+void daCreateWithStorage(void *daptr, dynSize elementSize, void *storage, size_t storageBytes)
+{
+    char *start = (char *)(((uintptr_t)storage + 15) & ~(uintptr_t)15);
+    size_t usable = storageBytes - (size_t)(start - (char *)storage);
+    dynArray *da;
+
+    if(*((char ***)daptr))
+        return; // already created, same as daCreate()
+    if(elementSize == 0)
+        elementSize = sizeof(char*);
+    if(!storage || (storageBytes < (size_t)(start - (char *)storage)) || (usable < (dynArrayHeaderSize + (size_t)elementSize)))
+    {
+        daCreate(daptr, elementSize); // too small to hold even one element; just use the heap
+        return;
+    }
+
+    da = (dynArray *)start;
+    memset(da, 0, dynArrayHeaderSize);
+    da->elementSize = elementSize;
+    da->capacity = (dynSize)((usable - dynArrayHeaderSize) / (size_t)elementSize);
+    da->flags = DAF_BORROWED;
+    *((char ***)daptr) = (char **)dynArrayToValues(da);
+}
+
+void daClone(void *dstptr, void *srcptr)
+{
+    dynArray *src = daGet((char ***)srcptr, 0, 0);
+    if(dstptr == srcptr)
+        return;
+    daDestroy(dstptr, NULL);
+    if(!src)
+        return;
+    if(src->flags & DAF_BORROWED)
+    {
+        // Caller storage can't outlive its owner, so this clone gets a real copy
+        daCreate(dstptr, src->elementSize);
+        daAppendArray(dstptr, srcptr);
+        return;
+    }
+
+    daRotateToFront(src); // from here on, only unshared copies of this block ever get rearranged
+    if(!(src->flags & DAF_SHARED))
+        src->flags |= DAF_SHARED; // refs is 0: nobody else can be looking at it yet
+    dynAtomicAdd64(daRefs(src), 1);
+    *((char ***)dstptr) = *((char ***)srcptr);
+}
+
+void daUnshare(void *daptr)
+{
+    daGetMutable((char ***)daptr, 0, 0);
+}
+
+void daSetGrowth(void *daptr, int policy, dynSize chunkSize)
+{
+    dynArray *da = daGetMutable((char ***)daptr, 0, 1);
+    if((policy < DA_GROW_DOUBLE) || (policy > DA_GROW_PAGES))
+        policy = DA_GROW_DOUBLE;
+    if(policy == DA_GROW_CHUNK)
+    {
+        if(chunkSize < 1)
+            chunkSize = 1;
+        if(chunkSize > 0x7fffffff)
+            chunkSize = 0x7fffffff;
+        da->growStep = (int)chunkSize;
+    }
+    da->flags = (da->flags & ~DAF_GROW_MASK) | (policy << DAF_GROW_SHIFT);
+}
+
+void daSetAutoShrink(void *daptr, int enabled)
+{
+    dynArray *da = daGetMutable((char ***)daptr, 0, 1);
+    if(enabled)
+    {
+        da->flags |= DAF_AUTO_SHRINK;
+        daAutoShrink((char ***)daptr, da);
+    }
+    else
+    {
+        da->flags &= ~DAF_AUTO_SHRINK;
+    }
+}
+
+// Swaps a shared block for a fresh empty one of the same kind, if other handles still use it
+static dynArray *daClearShared(char ***daptr, dynArray *da)
+{
+    dynSize elementSize = da->elementSize;
+    int settings = da->flags & DAF_SETTINGS;
+    int growStep = da->growStep;
+    if(!daDropShared(daptr, da))
+        return da;
+    da = daGet(daptr, elementSize, 1);
+    da->flags |= settings;
+    da->growStep = growStep;
+    return da;
+}
+
 void daDestroyIndirect(void *daptr, void * destroyFunc)
 {
     dynArray *da = daGet((char ***)daptr, 0, 0);
-    if(da)
+    if(da && !daDropShared((char ***)daptr, da))
     {
         daClearIndirect(daptr, destroyFunc);
-        free(da);
+        daFree(da);
         *((char ***)daptr) = NULL;
     }
 }
@@ -199,10 +600,21 @@ void daDestroyIndirect(void *daptr, void * destroyFunc)
 void daDestroy(void *daptr, void * destroyFunc)
 {
     dynArray *da = daGet((char ***)daptr, 0, 0);
-    if(da)
+    if(da && !daDropShared((char ***)daptr, da))
     {
         daClear(daptr, destroyFunc);
-        free(da);
+        daFree(da);
+        *((char ***)daptr) = NULL;
+    }
+}
+
+void daDestroyBatch(void *daptr, void * destroyFunc)
+{
+    dynArray *da = daGet((char ***)daptr, 0, 0);
+    if(da && !daDropShared((char ***)daptr, da))
+    {
+        daClearBatch(daptr, destroyFunc);
+        daFree(da);
         *((char ***)daptr) = NULL;
     }
 }
@@ -215,10 +627,10 @@ void daDestroyStrings(void *daptr)
 void daDestroyP1(void *daptr, void * destroyFunc, void *p1)
 {
     dynArray *da = daGet((char ***)daptr, 0, 0);
-    if(da)
+    if(da && !daDropShared((char ***)daptr, da))
     {
         daClearP1(daptr, destroyFunc, p1);
-        free(da);
+        daFree(da);
         *((char ***)daptr) = NULL;
     }
 }
@@ -226,10 +638,10 @@ void daDestroyP1(void *daptr, void * destroyFunc, void *p1)
 void daDestroyP2(void *daptr, void * destroyFunc, void *p1, void *p2)
 {
     dynArray *da = daGet((char ***)daptr, 0, 0);
-    if(da)
+    if(da && !daDropShared((char ***)daptr, da))
     {
         daClearP2(daptr, destroyFunc, p1, p2);
-        free(da);
+        daFree(da);
         *((char ***)daptr) = NULL;
     }
 }
@@ -237,40 +649,70 @@ void daDestroyP2(void *daptr, void * destroyFunc, void *p1, void *p2)
 void daClearIndirect(void *daptr, void * destroyFunc)
 {
     dynArray *da = daGet((char ***)daptr, 0, 0);
+    if(da && (da->flags & DAF_SHARED))
+        da = daClearShared((char ***)daptr, da);
     if(da)
     {
         daClearRange(da, 0, da->size, destroyFunc, 0);
         da->size = 0;
+        da->head = 0;
+        daAutoShrink((char ***)daptr, da);
     }
 }
 
 void daClear(void *daptr, void * destroyFunc)
 {
     dynArray *da = daGet((char ***)daptr, 0, 0);
+    if(da && (da->flags & DAF_SHARED))
+        da = daClearShared((char ***)daptr, da);
     if(da)
     {
         daClearRange(da, 0, da->size, destroyFunc, 1);
         da->size = 0;
+        da->head = 0;
+        daAutoShrink((char ***)daptr, da);
     }
 }
 
 void daClearP1(void *daptr, void * destroyFunc, void *p1)
 {
     dynArray *da = daGet((char ***)daptr, 0, 0);
+    if(da && (da->flags & DAF_SHARED))
+        da = daClearShared((char ***)daptr, da);
     if(da)
     {
         daClearRangeP1(da, 0, da->size, destroyFunc, p1);
         da->size = 0;
+        da->head = 0;
+        daAutoShrink((char ***)daptr, da);
     }
 }
 
 void daClearP2(void *daptr, void * destroyFunc, void *p1, void *p2)
 {
     dynArray *da = daGet((char ***)daptr, 0, 0);
+    if(da && (da->flags & DAF_SHARED))
+        da = daClearShared((char ***)daptr, da);
     if(da)
     {
         daClearRangeP2(da, 0, da->size, destroyFunc, p1, p2);
         da->size = 0;
+        da->head = 0;
+        daAutoShrink((char ***)daptr, da);
+    }
+}
+
+void daClearBatch(void *daptr, void * destroyFunc)
+{
+    dynArray *da = daGet((char ***)daptr, 0, 0);
+    if(da && (da->flags & DAF_SHARED))
+        da = daClearShared((char ***)daptr, da);
+    if(da)
+    {
+        daClearRangeBatch(da, 0, da->size, destroyFunc);
+        da->size = 0;
+        da->head = 0;
+        daAutoShrink((char ***)daptr, da);
     }
 }
 
@@ -285,13 +727,24 @@ void daClearStrings(void *daptr)
 // aka "pop front"
 int daShift(void *daptr, void *elementPtr)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 0);
+    dynArray *da = daGetMutable((char ***)daptr, 0, 0);
     if(da && da->size > 0)
     {
         char *values = dynArrayToValues(da);
+        if(da->flags & DAF_DEQUE)
+        {
+            memcpy(elementPtr, daSlot(da, 0), da->elementSize);
+            --da->size;
+            ++da->head;
+            if((da->head == da->capacity) || (da->size == 0))
+                da->head = 0;
+            daAutoShrink((char ***)daptr, da);
+            return 1;
+        }
         memcpy(elementPtr, values, da->elementSize);
         --da->size;
         memmove(values, values + da->elementSize, da->elementSize * da->size);
+        daAutoShrink((char ***)daptr, da);
         return 1;
     }
     return 0;
@@ -301,6 +754,13 @@ void daUnshiftIndirect(void *daptr, void *p)
 {
     dynArray *da = daMakeRoom(daptr, 1);
     char *values = dynArrayToValues(da);
+    if(da->flags & DAF_DEQUE)
+    {
+        da->head = (da->head > 0) ? (da->head - 1) : (da->capacity - 1);
+        memcpy(values + (da->head * da->elementSize), p, da->elementSize);
+        da->size++;
+        return;
+    }
     if(da->size > 0)
     {
         memmove(values + da->elementSize, values, da->elementSize * da->size);
@@ -329,11 +789,10 @@ void daUnshiftF32(void *daptr, dynF32 v)
     daUnshiftIndirect(daptr, &v);
 }
 
-dynSize daPushIndirect(void *daptr, void *entry)
+dynSize (daPushIndirect)(void *daptr, void *entry)
 {
     dynArray *da = daMakeRoom(daptr, 1);
-    char *values = dynArrayToValues(da);
-    memcpy(values + (da->elementSize * da->size), entry, da->elementSize);
+    memcpy(daSlot(da, da->size), entry, da->elementSize);
     ++da->size;
     return da->size - 1;
 }
@@ -341,40 +800,41 @@ dynSize daPushIndirect(void *daptr, void *entry)
 dynSize daPush0(void *daptr)
 {
     dynArray *da = daMakeRoom(daptr, 1);
-    char *values = dynArrayToValues(da);
-    memset(values + (da->elementSize * da->size), 0, da->elementSize);
+    memset(daSlot(da, da->size), 0, da->elementSize);
     ++da->size;
     return da->size - 1;
 }
 
-dynSize daPushU8(void *daptr, dynU8 v)
+dynSize (daPushU8)(void *daptr, dynU8 v)
 {
     return daPushIndirect(daptr, &v);
 }
 
-dynSize daPushU16(void *daptr, dynU16 v)
+dynSize (daPushU16)(void *daptr, dynU16 v)
 {
     return daPushIndirect(daptr, &v);
 }
 
-dynSize daPushU32(void *daptr, dynU32 v)
+dynSize (daPushU32)(void *daptr, dynU32 v)
 {
     return daPushIndirect(daptr, &v);
 }
 
-dynSize daPushF32(void *daptr, dynF32 v)
+dynSize (daPushF32)(void *daptr, dynF32 v)
 {
     return daPushIndirect(daptr, &v);
 }
 
 int daPop(void *daptr, void *elementPtr)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 0);
+    dynArray *da = daGetMutable((char ***)daptr, 0, 0);
     if(da && (da->size > 0))
     {
-        char *values = dynArrayToValues(da);
         --da->size;
-        memcpy(elementPtr, values + (da->elementSize * da->size), da->elementSize);
+        memcpy(elementPtr, daSlot(da, da->size), da->elementSize);
+        if(da->size == 0)
+            da->head = 0;
+        daAutoShrink((char ***)daptr, da);
         return 1;
     }
     return 0;
@@ -386,6 +846,7 @@ int daPop(void *daptr, void *elementPtr)
 void daInsertIndirect(void *daptr, dynSize index, void *p)
 {
     dynArray *da = daMakeRoom(daptr, 1);
+    daRotateToFront(da);
     if((index < 0) || (!da->size) || (index >= da->size))
     {
         daPush(daptr, *((char **)p));
@@ -421,15 +882,203 @@ void daInsertF32(void *daptr, dynSize index, dynF32 v)
 
 void daErase(void *daptr, dynSize index)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 0);
-    char *values = dynArrayToValues(da);
+    dynArray *da = daGetMutable((char ***)daptr, 0, 0);
+    char *values;
     if(!da)
         return;
     if((index < 0) || (!da->size) || (index >= da->size))
         return;
 
-    memmove(values + (index * da->elementSize), values + ((index + 1) * da->elementSize), da->elementSize * (da->size - index));
+    daRotateToFront(da);
+    values = dynArrayToValues(da);
+    memmove(values + (index * da->elementSize), values + ((index + 1) * da->elementSize), da->elementSize * (da->size - index - 1));
     --da->size;
+    daAutoShrink((char ***)daptr, da);
+}
+
+void daEraseFast(void *daptr, dynSize index)
+{
+    dynArray *da = daGetMutable((char ***)daptr, 0, 0);
+    if(!da)
+        return;
+    if((index < 0) || (!da->size) || (index >= da->size))
+        return;
+
+    if(index != (da->size - 1))
+        memcpy(daSlot(da, index), daSlot(da, da->size - 1), da->elementSize);
+    --da->size;
+    daAutoShrink((char ***)daptr, da);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bulk / range manipulation
+
+dynSize daPushN(void *daptr, const void *src, dynSize count)
+{
+    dynArray *da;
+    if(count < 0)
+        count = 0;
+    da = daMakeRoom(daptr, count);
+    if(count > 0)
+    {
+        daCopyToSlots(da, da->size, (const char *)src, count);
+        da->size += count;
+    }
+    return da->size - count;
+}
+
+void daInsertRange(void *daptr, dynSize index, const void *src, dynSize count)
+{
+    dynArray *da;
+    if(count < 0)
+        count = 0;
+    da = daMakeRoom(daptr, count);
+    daRotateToFront(da);
+    if((index < 0) || (index >= da->size))
+    {
+        daPushN(daptr, src, count);
+    }
+    else if(count > 0)
+    {
+        char *values = dynArrayToValues(da);
+        memmove(values + ((index + count) * da->elementSize), values + (index * da->elementSize), da->elementSize * (da->size - index));
+        daCopyToSlots(da, index, (const char *)src, count);
+        da->size += count;
+    }
+}
+
+void daEraseRange(void *daptr, dynSize index, dynSize count)
+{
+    dynArray *da = daGetMutable((char ***)daptr, 0, 0);
+    char *values;
+    if(!da)
+        return;
+    if((index < 0) || (index >= da->size) || (count <= 0))
+        return;
+    if(count > (da->size - index))
+        count = da->size - index;
+
+    daRotateToFront(da);
+    values = dynArrayToValues(da);
+    memmove(values + (index * da->elementSize), values + ((index + count) * da->elementSize), da->elementSize * (da->size - index - count));
+    da->size -= count;
+    daAutoShrink((char ***)daptr, da);
+}
+
+dynSize daRemoveIf(void *daptr, void * /*dynPredicateFunc*/ predicate, void *userData, void * destroyFunc)
+{
+    dynArray *da = daGetMutable((char ***)daptr, 0, 0);
+    dynPredicateFunc func = (dynPredicateFunc)predicate;
+    dynSize head = 0;
+    dynSize tail = 0;
+    dynSize runStart = 0;
+    dynSize removed;
+    char *values;
+    if(!da || !da->size)
+        return 0;
+
+    // Kept elements are slid down a run at a time, so this is one pass no matter how many go
+    daRotateToFront(da);
+    values = dynArrayToValues(da);
+    for( ; tail < da->size; ++tail)
+    {
+        char *element = values + (tail * da->elementSize);
+        if(func(element, userData))
+        {
+            if((tail > runStart) && (head != runStart))
+                memmove(values + (head * da->elementSize), values + (runStart * da->elementSize), (tail - runStart) * da->elementSize);
+            head += tail - runStart;
+            runStart = tail + 1;
+            if(destroyFunc)
+                ((dynDestroyFunc)destroyFunc)(*((char **)element));
+        }
+    }
+    if((tail > runStart) && (head != runStart))
+        memmove(values + (head * da->elementSize), values + (runStart * da->elementSize), (tail - runStart) * da->elementSize);
+    head += tail - runStart;
+
+    removed = da->size - head;
+    da->size = head;
+    daAutoShrink((char ***)daptr, da);
+    return removed;
+}
+
+void daAppendArray(void *daptr, void *srcptr)
+{
+    dynArray *src = daGet((char ***)srcptr, 0, 0);
+    dynArray *da;
+    if(!src || !src->size)
+        return;
+
+    da = daGetMutable((char ***)daptr, src->elementSize, 1);
+    src = daGet((char ***)srcptr, 0, 0); // unsharing moves it, if it's the same handle
+    if(da->elementSize != src->elementSize)
+        return;
+    if(da == src)
+    {
+        daRotateToFront(da);
+        daPushN(daptr, NULL, da->size); // makes room; src may have moved
+        da = daGet((char ***)daptr, 0, 0);
+        memcpy(dynArrayToValues(da) + ((da->size / 2) * da->elementSize), dynArrayToValues(da), (da->size / 2) * da->elementSize);
+        return;
+    }
+    da = daMakeRoom(daptr, src->size);
+    if(!(da->flags & DAF_DEQUE) && !(src->flags & DAF_DEQUE))
+    {
+        memcpy(dynArrayToValues(da) + (da->size * da->elementSize), dynArrayToValues(src), src->size * src->elementSize);
+    }
+    else
+    {
+        char *runs[2];
+        dynSize counts[2];
+        dynSize offset = 0;
+        int runCount = daRuns(src, 0, src->size, runs, counts);
+        int i;
+        for(i = 0; i < runCount; ++i)
+        {
+            daCopyToSlots(da, da->size + offset, runs[i], counts[i]);
+            offset += counts[i];
+        }
+    }
+    da->size += src->size;
+}
+
+void daSlice(void *dstptr, void *srcptr, dynSize start, dynSize end)
+{
+    dynArray *src = daGet((char ***)srcptr, 0, 0);
+    dynArray *dst;
+    dynSize count;
+    if(!src || (dstptr == srcptr))
+        return;
+    if(start < 0)
+        start = 0;
+    if((end < 0) || (end > src->size))
+        end = src->size;
+    count = (end > start) ? (end - start) : 0;
+
+    dst = daGetMutable((char ***)dstptr, src->elementSize, 1);
+    dst->size = 0;
+    dst->head = 0;
+    if(dst->elementSize != src->elementSize)
+        return;
+    dst = daMakeRoom(dstptr, count);
+    daCopyFromSlots(src, start, dynArrayToValues(dst), count);
+    dst->size = count;
+}
+
+void *daAt(void *daptr, dynSize index)
+{
+    dynArray *da = daGet((char ***)daptr, 0, 0);
+    if(!da || (index < 0) || (index >= da->size))
+        return NULL;
+    return daSlot(da, index);
+}
+
+void daLinearize(void *daptr)
+{
+    dynArray *da = daGet((char ***)daptr, 0, 0);
+    if(da)
+        daRotateToFront(da);
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -437,33 +1086,52 @@ void daErase(void *daptr, dynSize index)
 
 void daSetSizeIndirect(void *daptr, dynSize newSize, void * destroyFunc)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 1);
+    dynArray *da = daGetMutable((char ***)daptr, 0, 1);
     daClearRange(da, newSize, da->size, destroyFunc, 0);
-    daChangeSize(daptr, newSize);
+    daChangeSize(daptr, newSize, 1);
 }
 
 void daSetSize(void *daptr, dynSize newSize, void * destroyFunc)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 1);
+    dynArray *da = daGetMutable((char ***)daptr, 0, 1);
     daClearRange(da, newSize, da->size, destroyFunc, 1);
-    daChangeSize(daptr, newSize);
+    daChangeSize(daptr, newSize, 1);
 }
 
 void daSetSizeP1(void *daptr, dynSize newSize, void * destroyFunc, void *p1)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 1);
+    dynArray *da = daGetMutable((char ***)daptr, 0, 1);
     daClearRangeP1(da, newSize, da->size, destroyFunc, p1);
-    daChangeSize(daptr, newSize);
+    daChangeSize(daptr, newSize, 1);
 }
 
 void daSetSizeP2(void *daptr, dynSize newSize, void * destroyFunc, void *p1, void *p2)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 1);
+    dynArray *da = daGetMutable((char ***)daptr, 0, 1);
     daClearRangeP2(da, newSize, da->size, destroyFunc, p1, p2);
-    daChangeSize(daptr, newSize);
+    daChangeSize(daptr, newSize, 1);
+}
+
+void daReserveUninit(void *daptr, dynSize newSize)
+{
+    daChangeSize(daptr, newSize, 0);
 }
 
-dynSize daSize(void *daptr)
+void *daPushUninit(void *daptr, dynSize count)
+{
+    dynArray *da;
+    void *first;
+    if(count < 0)
+        count = 0;
+    da = daMakeRoom(daptr, count);
+    if((da->flags & DAF_DEQUE) && ((da->head + da->size + count) > da->capacity))
+        daRotateToFront(da); // the caller needs one contiguous run
+    first = daSlot(da, da->size);
+    da->size += count;
+    return first;
+}
+
+dynSize (daSize)(void *daptr)
 {
     dynArray *da = daGet((char ***)daptr, 0, 0);
     if(da)
@@ -473,33 +1141,33 @@ dynSize daSize(void *daptr)
 
 void daSetCapacityIndirect(void *daptr, dynSize newCapacity, void * destroyFunc)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 1);
+    dynArray *da = daGetMutable((char ***)daptr, 0, 1);
     daClearRange(da, newCapacity, da->size, destroyFunc, 0);
     daChangeCapacity(newCapacity, 0, daptr);
 }
 
 void daSetCapacity(void *daptr, dynSize newCapacity, void * destroyFunc)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 1);
+    dynArray *da = daGetMutable((char ***)daptr, 0, 1);
     daClearRange(da, newCapacity, da->size, destroyFunc, 1);
     daChangeCapacity(newCapacity, 0, daptr);
 }
 
 void daSetCapacityP1(void *daptr, dynSize newCapacity, void * destroyFunc, void *p1)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 1);
+    dynArray *da = daGetMutable((char ***)daptr, 0, 1);
     daClearRangeP1(da, newCapacity, da->size, destroyFunc, p1);
     daChangeCapacity(newCapacity, 0, daptr);
 }
 
 void daSetCapacityP2(void *daptr, dynSize newCapacity, void * destroyFunc, void *p1, void *p2)
 {
-    dynArray *da = daGet((char ***)daptr, 0, 1);
+    dynArray *da = daGetMutable((char ***)daptr, 0, 1);
     daClearRangeP2(da, newCapacity, da->size, destroyFunc, p1, p2);
     daChangeCapacity(newCapacity, 0, daptr);
 }
 
-dynSize daCapacity(void *daptr)
+dynSize (daCapacity)(void *daptr)
 {
     dynArray *da = daGet((char ***)daptr, 0, 0);
     if(da)
@@ -507,34 +1175,39 @@ dynSize daCapacity(void *daptr)
     return 0;
 }
 
-void daSquash(void *daptr)
+void daShrinkToFit(void *daptr)
 {
     dynArray *da = daGet((char ***)daptr, 0, 0);
+    if(!da || (da->flags & DAF_FOREIGN))
+        return; // caller storage and mappings are already as small as they get
+    da = daGetMutable((char ***)daptr, 0, 0);
+    daChangeCapacity(da->size, 0, (char ***)daptr);
+}
+
+void daSquash(void *daptr)
+{
+    dynArray *da = daGetMutable((char ***)daptr, 0, 0);
     if(da)
     {
-        int head = 0;
-        int tail = 0;
-        int i;
-        char *values = dynArrayToValues(da);
-        for( ; tail < da->size ; ++tail)
+        dynSize head = 0;
+        dynSize tail = 0;
+        char *values;
+        daRotateToFront(da);
+        values = dynArrayToValues(da);
+        while(tail < da->size)
         {
-            int keep = 0;
-            char *src = values + (tail * da->elementSize);
-            for(i = 0; i < da->elementSize; ++i)
-            {
-                if(src[i] != 0)
-                {
-                    keep = 1;
-                    break;
-                }
-            }
-            if(keep)
+            dynSize run = daNonZeroRun(values + (tail * da->elementSize), da->size - tail, da->elementSize);
+            if(run > 0)
             {
-                char *dst = values + (head * da->elementSize);
-                memcpy(dst, src, da->elementSize);
-                head++;
+                if(head != tail)
+                    memmove(values + (head * da->elementSize), values + (tail * da->elementSize), run * da->elementSize);
+                head += run;
+                tail += run;
             }
+            while((tail < da->size) && daIsZeroElement(values + (tail * da->elementSize), da->elementSize))
+                ++tail;
         }
         da->size = head;
+        daAutoShrink((char ***)daptr, da);
     }
 }
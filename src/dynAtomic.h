@@ -0,0 +1,117 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#ifndef DYN_ATOMIC_H
+#define DYN_ATOMIC_H
+
+// Minimal atomics shared by dyn's threaded pieces. This is an internal header; it is not
+// installed alongside dyn.h.
+
+#include "dyn.h"
+
+#if defined(_MSC_VER)
+
+#include <windows.h>
+
+typedef volatile LONG64 dynAtomic64;
+typedef void * volatile dynAtomicPtr;
+
+DYN_INLINE long long dynAtomicLoad64(dynAtomic64 *p)
+{
+    return InterlockedCompareExchange64(p, 0, 0);
+}
+
+DYN_INLINE void dynAtomicStore64(dynAtomic64 *p, long long v)
+{
+    InterlockedExchange64(p, v);
+}
+
+// Interlocked* are full barriers, so these are just the sequentially consistent versions
+DYN_INLINE long long dynAtomicLoadAcquire64(dynAtomic64 *p)
+{
+    return InterlockedCompareExchange64(p, 0, 0);
+}
+
+DYN_INLINE void dynAtomicStoreRelease64(dynAtomic64 *p, long long v)
+{
+    InterlockedExchange64(p, v);
+}
+
+// returns the value before the add
+DYN_INLINE long long dynAtomicAdd64(dynAtomic64 *p, long long v)
+{
+    return InterlockedExchangeAdd64(p, v);
+}
+
+// returns non-zero if *p held expected and was replaced
+DYN_INLINE int dynAtomicCAS64(dynAtomic64 *p, long long expected, long long desired)
+{
+    return InterlockedCompareExchange64(p, desired, expected) == expected;
+}
+
+DYN_INLINE void *dynAtomicLoadPtr(dynAtomicPtr *p)
+{
+    return InterlockedCompareExchangePointer(p, NULL, NULL);
+}
+
+DYN_INLINE int dynAtomicCASPtr(dynAtomicPtr *p, void *expected, void *desired)
+{
+    return InterlockedCompareExchangePointer(p, desired, expected) == expected;
+}
+
+#else
+
+typedef volatile long long dynAtomic64;
+typedef void * volatile dynAtomicPtr;
+
+DYN_INLINE long long dynAtomicLoad64(dynAtomic64 *p)
+{
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+DYN_INLINE void dynAtomicStore64(dynAtomic64 *p, long long v)
+{
+    __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+// For publishing data to exactly one other thread: the store releases what was written before it,
+// and a load that sees it acquires all of that
+DYN_INLINE long long dynAtomicLoadAcquire64(dynAtomic64 *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+DYN_INLINE void dynAtomicStoreRelease64(dynAtomic64 *p, long long v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+// returns the value before the add
+DYN_INLINE long long dynAtomicAdd64(dynAtomic64 *p, long long v)
+{
+    return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST);
+}
+
+// returns non-zero if *p held expected and was replaced
+DYN_INLINE int dynAtomicCAS64(dynAtomic64 *p, long long expected, long long desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+DYN_INLINE void *dynAtomicLoadPtr(dynAtomicPtr *p)
+{
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+DYN_INLINE int dynAtomicCASPtr(dynAtomicPtr *p, void *expected, void *desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,349 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "dyn.h"
+#include "dynSimd.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ------------------------------------------------------------------------------------------------
+// Constants and Macros
+
+#define wordsFor(BITCOUNT) (((BITCOUNT) + 63) >> 6)
+
+// ------------------------------------------------------------------------------------------------
+// Internal helper functions
+
+static int popcount64(dynU64 x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static int lowestSetBit(dynU64 x) // x must not be 0
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int bit = 0;
+    while(!(x & 1))
+    {
+        x >>= 1;
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+// Keeps the "bits past bitCount are 0" promise that dbCount() and friends rely on
+static void dbTrim(dynBitset *bs)
+{
+    if(bs->bitCount & 63)
+        bs->words[(bs->bitCount - 1) >> 6] &= (((dynU64)1) << (bs->bitCount & 63)) - 1;
+}
+
+static dynSize dbWordCount(dynBitset *bs)
+{
+    return wordsFor(bs->bitCount);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Kernels
+//
+// Every kernel walks count words; the vector versions leave the last few to the scalar loop.
+// Popcounts are generated twice: once over a single bitset, and once over the AND of two.
+
+#define POPCOUNT_FUNCS(SUFFIX, SCALAR_WORD, SSE2_LOAD, AVX2_LOAD)                             \
+static dynSize popcount ## SUFFIX ## Scalar(const dynU64 *a, const dynU64 *b, dynSize start, dynSize count) \
+{                                                                                            \
+    dynSize total = 0;                                                                       \
+    dynSize i;                                                                               \
+    (void)b;                                                                                 \
+    for(i = start; i < count; ++i)                                                           \
+        total += popcount64(SCALAR_WORD);                                                    \
+    return total;                                                                            \
+}                                                                                            \
+                                                                                             \
+POPCOUNT_VECTOR_FUNCS(SUFFIX, SSE2_LOAD, AVX2_LOAD)                                          \
+                                                                                             \
+static dynSize popcount ## SUFFIX(const dynU64 *a, const dynU64 *b, dynSize count)           \
+{                                                                                            \
+    switch(dynSimdLevel())                                                                   \
+    {                                                                                        \
+        POPCOUNT_VECTOR_CASES(SUFFIX)                                                        \
+        default: return popcount ## SUFFIX ## Scalar(a, b, 0, count);                        \
+    }                                                                                        \
+}
+
+#define BITWISE_FUNCS(SUFFIX, SCALAR_OP, SSE2_OP, AVX2_OP)                                   \
+static void bitwise ## SUFFIX ## Scalar(dynU64 *dst, const dynU64 *src, dynSize start, dynSize count) \
+{                                                                                            \
+    dynSize i;                                                                               \
+    for(i = start; i < count; ++i)                                                           \
+        dst[i] = SCALAR_OP(dst[i], src[i]);                                                  \
+}                                                                                            \
+                                                                                             \
+BITWISE_VECTOR_FUNCS(SUFFIX, SSE2_OP, AVX2_OP)                                               \
+                                                                                             \
+static void bitwise ## SUFFIX(dynU64 *dst, const dynU64 *src, dynSize count)                 \
+{                                                                                            \
+    switch(dynSimdLevel())                                                                   \
+    {                                                                                        \
+        BITWISE_VECTOR_CASES(SUFFIX)                                                         \
+        default: bitwise ## SUFFIX ## Scalar(dst, src, 0, count); break;                     \
+    }                                                                                        \
+}
+
+#if DYN_SIMD_X86
+
+// SSE2 has no byte shuffle, so it counts bits with the classic shift-and-mask reduction and
+// then sums the byte counts with psadbw. AVX2 looks each nibble's count up with vpshufb.
+#define POPCOUNT_VECTOR_FUNCS(SUFFIX, SSE2_LOAD, AVX2_LOAD)                                   \
+DYN_TARGET("sse2") static dynSize popcount ## SUFFIX ## SSE2(const dynU64 *a, const dynU64 *b, dynSize count) \
+{                                                                                            \
+    __m128i m1 = _mm_set1_epi8(0x55);                                                        \
+    __m128i m2 = _mm_set1_epi8(0x33);                                                        \
+    __m128i m4 = _mm_set1_epi8(0x0f);                                                        \
+    __m128i acc = _mm_setzero_si128();                                                       \
+    dynU64 lanes[2];                                                                         \
+    dynSize i;                                                                               \
+    (void)b;                                                                                 \
+    for(i = 0; (i + 2) <= count; i += 2)                                                     \
+    {                                                                                        \
+        __m128i x = SSE2_LOAD;                                                               \
+        x = _mm_sub_epi8(x, _mm_and_si128(_mm_srli_epi64(x, 1), m1));                        \
+        x = _mm_add_epi8(_mm_and_si128(x, m2), _mm_and_si128(_mm_srli_epi64(x, 2), m2));     \
+        x = _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi64(x, 4)), m4);                        \
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(x, _mm_setzero_si128()));                      \
+    }                                                                                        \
+    _mm_storeu_si128((__m128i *)lanes, acc);                                                 \
+    return (dynSize)(lanes[0] + lanes[1]) + popcount ## SUFFIX ## Scalar(a, b, i, count);    \
+}                                                                                            \
+                                                                                             \
+DYN_TARGET("avx2") static dynSize popcount ## SUFFIX ## AVX2(const dynU64 *a, const dynU64 *b, dynSize count) \
+{                                                                                            \
+    __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,         \
+                                     0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);        \
+    __m256i low = _mm256_set1_epi8(0x0f);                                                    \
+    __m256i acc = _mm256_setzero_si256();                                                    \
+    dynU64 lanes[4];                                                                         \
+    dynSize i;                                                                               \
+    (void)b;                                                                                 \
+    for(i = 0; (i + 4) <= count; i += 4)                                                     \
+    {                                                                                        \
+        __m256i x = AVX2_LOAD;                                                               \
+        __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(x, low)), \
+                                         _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), low))); \
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(counts, _mm256_setzero_si256()));        \
+    }                                                                                        \
+    _mm256_storeu_si256((__m256i *)lanes, acc);                                              \
+    return (dynSize)(lanes[0] + lanes[1] + lanes[2] + lanes[3]) + popcount ## SUFFIX ## Scalar(a, b, i, count); \
+}
+
+#define POPCOUNT_VECTOR_CASES(SUFFIX)                                                        \
+    case SIMD_AVX2: return popcount ## SUFFIX ## AVX2(a, b, count);                          \
+    case SIMD_SSE2: return popcount ## SUFFIX ## SSE2(a, b, count);
+
+#define BITWISE_VECTOR_FUNCS(SUFFIX, SSE2_OP, AVX2_OP)                                       \
+DYN_TARGET("sse2") static void bitwise ## SUFFIX ## SSE2(dynU64 *dst, const dynU64 *src, dynSize count) \
+{                                                                                            \
+    dynSize i;                                                                               \
+    for(i = 0; (i + 2) <= count; i += 2)                                                     \
+    {                                                                                        \
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));                             \
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));                             \
+        _mm_storeu_si128((__m128i *)(dst + i), SSE2_OP(d, s));                               \
+    }                                                                                        \
+    bitwise ## SUFFIX ## Scalar(dst, src, i, count);                                         \
+}                                                                                            \
+                                                                                             \
+DYN_TARGET("avx2") static void bitwise ## SUFFIX ## AVX2(dynU64 *dst, const dynU64 *src, dynSize count) \
+{                                                                                            \
+    dynSize i;                                                                               \
+    for(i = 0; (i + 4) <= count; i += 4)                                                     \
+    {                                                                                        \
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));                          \
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));                          \
+        _mm256_storeu_si256((__m256i *)(dst + i), AVX2_OP(d, s));                            \
+    }                                                                                        \
+    bitwise ## SUFFIX ## Scalar(dst, src, i, count);                                         \
+}
+
+#define BITWISE_VECTOR_CASES(SUFFIX)                                                         \
+    case SIMD_AVX2: bitwise ## SUFFIX ## AVX2(dst, src, count); break;                       \
+    case SIMD_SSE2: bitwise ## SUFFIX ## SSE2(dst, src, count); break;
+
+#define loadSSE2(P) _mm_loadu_si128((const __m128i *)((P) + i))
+#define loadAVX2(P) _mm256_loadu_si256((const __m256i *)((P) + i))
+#define andNotSSE2(D, S) _mm_andnot_si128(S, D)
+#define andNotAVX2(D, S) _mm256_andnot_si256(S, D)
+
+#else // !DYN_SIMD_X86
+
+#define POPCOUNT_VECTOR_FUNCS(SUFFIX, SSE2_LOAD, AVX2_LOAD)
+#define POPCOUNT_VECTOR_CASES(SUFFIX)
+#define BITWISE_VECTOR_FUNCS(SUFFIX, SSE2_OP, AVX2_OP)
+#define BITWISE_VECTOR_CASES(SUFFIX)
+
+#endif
+
+#define scalarAnd(D, S) ((D) & (S))
+#define scalarOr(D, S) ((D) | (S))
+#define scalarAndNot(D, S) ((D) & ~(S))
+#define scalarXor(D, S) ((D) ^ (S))
+
+POPCOUNT_FUNCS(One, a[i], loadSSE2(a), loadAVX2(a))
+POPCOUNT_FUNCS(And, a[i] & b[i], _mm_and_si128(loadSSE2(a), loadSSE2(b)), _mm256_and_si256(loadAVX2(a), loadAVX2(b)))
+BITWISE_FUNCS(And, scalarAnd, _mm_and_si128, _mm256_and_si256)
+BITWISE_FUNCS(Or, scalarOr, _mm_or_si128, _mm256_or_si256)
+BITWISE_FUNCS(AndNot, scalarAndNot, andNotSSE2, andNotAVX2)
+BITWISE_FUNCS(Xor, scalarXor, _mm_xor_si128, _mm256_xor_si256)
+
+// ------------------------------------------------------------------------------------------------
+// creation / destruction / cleanup
+
+dynBitset *dbCreate(dynSize bitCount)
+{
+    dynBitset *bs = (dynBitset *)calloc(1, sizeof(*bs));
+    daCreate(&bs->words, sizeof(dynU64));
+    dbResize(bs, bitCount);
+    return bs;
+}
+
+void dbDestroy(dynBitset *bs)
+{
+    if(bs)
+    {
+        daDestroy(&bs->words, NULL);
+        free(bs);
+    }
+}
+
+void dbResize(dynBitset *bs, dynSize bitCount)
+{
+    if(bitCount < 0)
+        bitCount = 0;
+    daSetSize(&bs->words, wordsFor(bitCount), NULL); // new words come in zeroed
+    bs->bitCount = bitCount;
+    dbTrim(bs);
+}
+
+void dbClearAll(dynBitset *bs)
+{
+    if(bs->bitCount > 0)
+        memset(bs->words, 0, (size_t)dbWordCount(bs) * sizeof(dynU64));
+}
+
+void dbSetAll(dynBitset *bs)
+{
+    if(bs->bitCount > 0)
+    {
+        memset(bs->words, 0xff, (size_t)dbWordCount(bs) * sizeof(dynU64));
+        dbTrim(bs);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Single bits
+
+void (dbSet)(dynBitset *bs, dynSize index)
+{
+    dbSetInline(bs, index);
+}
+
+void (dbReset)(dynBitset *bs, dynSize index)
+{
+    dbResetInline(bs, index);
+}
+
+int (dbTest)(dynBitset *bs, dynSize index)
+{
+    return dbTestInline(bs, index);
+}
+
+dynSize dbNextSet(dynBitset *bs, dynSize start)
+{
+    dynSize wordCount = dbWordCount(bs);
+    dynSize wordIndex;
+    dynU64 word;
+    if(start < 0)
+        start = 0;
+    if(start >= bs->bitCount)
+        return -1;
+
+    wordIndex = start >> 6;
+    word = bs->words[wordIndex] & (~(dynU64)0 << (start & 63));
+    for(;;)
+    {
+        if(word)
+            return (wordIndex << 6) + lowestSetBit(word); // trailing bits are 0, so this is in range
+        if(++wordIndex >= wordCount)
+            return -1;
+        word = bs->words[wordIndex];
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Whole sets
+
+dynSize dbCount(dynBitset *bs)
+{
+    return popcountOne(bs->words, NULL, dbWordCount(bs));
+}
+
+dynSize dbAndCount(dynBitset *a, dynBitset *b)
+{
+    dynSize count = dbWordCount(a);
+    if(dbWordCount(b) < count)
+        count = dbWordCount(b);
+    return popcountAnd(a->words, b->words, count);
+}
+
+void dbAnd(dynBitset *dst, dynBitset *src)
+{
+    dynSize count = dbWordCount(dst);
+    dynSize srcCount = dbWordCount(src);
+    if(srcCount < count)
+    {
+        memset(dst->words + srcCount, 0, (size_t)(count - srcCount) * sizeof(dynU64));
+        count = srcCount;
+    }
+    bitwiseAnd(dst->words, src->words, count);
+}
+
+void dbOr(dynBitset *dst, dynBitset *src)
+{
+    dynSize count = dbWordCount(dst);
+    if(dbWordCount(src) < count)
+        count = dbWordCount(src);
+    bitwiseOr(dst->words, src->words, count);
+    dbTrim(dst);
+}
+
+void dbAndNot(dynBitset *dst, dynBitset *src)
+{
+    dynSize count = dbWordCount(dst);
+    if(dbWordCount(src) < count)
+        count = dbWordCount(src);
+    bitwiseAndNot(dst->words, src->words, count);
+}
+
+void dbXor(dynBitset *dst, dynBitset *src)
+{
+    dynSize count = dbWordCount(dst);
+    if(dbWordCount(src) < count)
+        count = dbWordCount(src);
+    bitwiseXor(dst->words, src->words, count);
+    dbTrim(dst);
+}
@@ -0,0 +1,176 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "dyn.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// ------------------------------------------------------------------------------------------------
+// Constants and Macros
+
+#define DEFAULT_CHUNK_BYTES (64 * 1024) // dcCreate(..., 0) aims for chunks about this big
+#define MIN_CHUNK_SHIFT     4           // never fewer than 16 elements per chunk
+#define MAX_CHUNK_SHIFT     30
+
+// ------------------------------------------------------------------------------------------------
+// Internal helper functions
+
+// Makes sure there is a chunk to hold element [index]; chunks are only ever appended
+static char *dcChunkFor(dynChunkArray *dc, dynSize index)
+{
+    dynSize chunkIndex = index >> dc->chunkShift;
+    if(chunkIndex >= daSize(&dc->chunks))
+    {
+        unsigned long long bytes = (unsigned long long)dc->elementSize << dc->chunkShift;
+        char *chunk;
+        if(bytes > (unsigned long long)SIZE_MAX)
+            abort();
+        chunk = (char *)malloc((size_t)bytes);
+        if(!chunk)
+            abort();
+        daPush(&dc->chunks, chunk);
+    }
+    return dc->chunks[chunkIndex];
+}
+
+static void dcDestroyRange(dynChunkArray *dc, dynSize start, dynSize end, void *destroyFunc)
+{
+    dynDestroyFunc func = (dynDestroyFunc)destroyFunc;
+    if(func)
+    {
+        dynSize i;
+        for(i = start; i < end; ++i)
+            func(dcAt(dc, i));
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// creation / destruction / cleanup
+
+dynChunkArray *dcCreate(dynSize elementSize, dynSize chunkSize)
+{
+    dynChunkArray *dc = (dynChunkArray *)calloc(1, sizeof(*dc));
+    int shift = MIN_CHUNK_SHIFT;
+    if(elementSize <= 0)
+        elementSize = sizeof(char*);
+    if(chunkSize <= 0)
+        chunkSize = DEFAULT_CHUNK_BYTES / elementSize;
+    while((shift < MAX_CHUNK_SHIFT) && (((dynSize)1 << shift) < chunkSize))
+        ++shift;
+
+    dc->elementSize = elementSize;
+    dc->chunkShift = shift;
+    dc->chunkMask = ((dynSize)1 << shift) - 1;
+    daCreate(&dc->chunks, sizeof(char*));
+    return dc;
+}
+
+void dcDestroy(dynChunkArray *dc, void * /*dynDestroyFunc*/ destroyFunc)
+{
+    if(dc)
+    {
+        dcClear(dc, destroyFunc);
+        daDestroy(&dc->chunks, NULL);
+        free(dc);
+    }
+}
+
+void dcClear(dynChunkArray *dc, void * /*dynDestroyFunc*/ destroyFunc)
+{
+    dcDestroyRange(dc, 0, dc->size, destroyFunc);
+    daClear(&dc->chunks, free);
+    dc->size = 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Growth / shrinkage
+
+void *dcPush(dynChunkArray *dc, const void *value)
+{
+    char *chunk = dcChunkFor(dc, dc->size);
+    char *element = chunk + ((dc->size & dc->chunkMask) * dc->elementSize);
+    if(value)
+        memcpy(element, value, dc->elementSize);
+    else
+        memset(element, 0, dc->elementSize);
+    ++dc->size;
+    return element;
+}
+
+dynSize dcPushN(dynChunkArray *dc, const void *src, dynSize count)
+{
+    dynSize first = dc->size;
+    const char *p = (const char *)src;
+    if(count > (dynSizeMax - dc->size))
+        abort();
+    while(count > 0)
+    {
+        // Fill the rest of the current chunk in one go
+        dynSize offset = dc->size & dc->chunkMask;
+        dynSize room = (dc->chunkMask + 1) - offset;
+        char *chunk = dcChunkFor(dc, dc->size);
+        if(room > count)
+            room = count;
+        if(p)
+        {
+            memcpy(chunk + (offset * dc->elementSize), p, (size_t)room * dc->elementSize);
+            p += room * dc->elementSize;
+        }
+        else
+        {
+            memset(chunk + (offset * dc->elementSize), 0, (size_t)room * dc->elementSize);
+        }
+        dc->size += room;
+        count -= room;
+    }
+    return first;
+}
+
+void dcPop(dynChunkArray *dc, void * /*dynDestroyFunc*/ destroyFunc)
+{
+    if(dc->size > 0)
+    {
+        dcDestroyRange(dc, dc->size - 1, dc->size, destroyFunc);
+        --dc->size; // the chunk stays around for the next push
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Access
+
+dynSize (dcSize)(dynChunkArray *dc)
+{
+    return dcSizeInline(dc);
+}
+
+void *(dcAt)(dynChunkArray *dc, dynSize index)
+{
+    return dcAtInline(dc, index);
+}
+
+dynSize dcChunkCount(dynChunkArray *dc)
+{
+    return (dc->size + dc->chunkMask) >> dc->chunkShift;
+}
+
+void *dcChunk(dynChunkArray *dc, dynSize chunkIndex, dynSize *count)
+{
+    dynSize start = chunkIndex << dc->chunkShift;
+    dynSize available;
+    if((chunkIndex < 0) || (start >= dc->size))
+    {
+        if(count)
+            *count = 0;
+        return NULL;
+    }
+    available = dc->size - start;
+    if(count)
+        *count = (available > (dc->chunkMask + 1)) ? (dc->chunkMask + 1) : available;
+    return dc->chunks[chunkIndex];
+}
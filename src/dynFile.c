@@ -0,0 +1,225 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "dyn.h"
+#include "dynFile.h"
+#include "dynSlots.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ------------------------------------------------------------------------------------------------
+// Constants and Macros
+
+// On-disk layout (native byte order, checked on load):
+//
+//   0  char[8]  "dynArray"
+//   8  u32      version
+//   12 u32      DA_FILE_BYTE_ORDER, as written by the saving machine
+//   16 u64      elementSize
+//   24 u64      element count
+//   32 u64      offset of the first element (DA_FILE_DATA_OFFSET)
+//   40 ...      zeros up to the elements
+//
+// The gap before the elements is where a mapped array's in-memory header goes, so the values can
+// be used straight out of the mapping.
+#define DA_FILE_MAGIC       "dynArray"
+#define DA_FILE_VERSION     1
+#define DA_FILE_BYTE_ORDER  0x01020304
+#define DA_FILE_DATA_OFFSET 4096
+
+// ------------------------------------------------------------------------------------------------
+// Internal structures
+
+typedef struct dynFileHeader
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int byteOrder;
+    unsigned long long elementSize;
+    unsigned long long count;
+    unsigned long long dataOffset;
+} dynFileHeader;
+
+// ------------------------------------------------------------------------------------------------
+// Internal helper functions
+
+static size_t dynPageSize(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (size_t)info.dwPageSize;
+#else
+    long pageSize = sysconf(_SC_PAGESIZE);
+    return (pageSize > 0) ? (size_t)pageSize : 4096;
+#endif
+}
+
+// Maps the whole file privately (copy-on-write, never written back). Returns NULL on failure.
+static char *dynFileMap(const char *path, unsigned long long *fileBytes)
+{
+    char *base = NULL;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    HANDLE mapping;
+    LARGE_INTEGER size;
+    if(file == INVALID_HANDLE_VALUE)
+        return NULL;
+    if(GetFileSizeEx(file, &size) && (size.QuadPart >= (LONGLONG)sizeof(dynFileHeader)))
+    {
+        mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if(mapping)
+        {
+            base = (char *)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(mapping); // the view keeps it alive
+        }
+        *fileBytes = (unsigned long long)size.QuadPart;
+    }
+    CloseHandle(file);
+#else
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+    if((fstat(fd, &st) == 0) && (st.st_size >= (off_t)sizeof(dynFileHeader)) && ((unsigned long long)st.st_size <= (unsigned long long)SIZE_MAX))
+    {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED)
+            base = (char *)p;
+        *fileBytes = (unsigned long long)st.st_size;
+    }
+    close(fd); // the mapping keeps the file alive
+#endif
+    return base;
+}
+
+static void dynFileUnmapRange(char *base, size_t bytes)
+{
+#ifdef _WIN32
+    (void)bytes;
+    UnmapViewOfFile(base);
+#else
+    munmap(base, bytes);
+#endif
+}
+
+// Makes every page after the one holding the in-memory header read-only
+static void dynFileProtect(char *base, size_t bytes)
+{
+    size_t pageSize = dynPageSize();
+    size_t start = ((DA_FILE_DATA_OFFSET + pageSize - 1) / pageSize) * pageSize;
+    if(start >= bytes)
+        return;
+#ifdef _WIN32
+    {
+        DWORD oldProtect;
+        VirtualProtect(base + start, bytes - start, PAGE_READONLY, &oldProtect);
+    }
+#else
+    mprotect(base + start, bytes - start, PROT_READ);
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+// Saving / mapping
+
+int daSaveFile(void *daptr, const char *path)
+{
+    dynFileHeader header;
+    static const char zeros[DA_FILE_DATA_OFFSET];
+    dynSize count = daSize(daptr);
+    FILE *f;
+    int ok;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DA_FILE_MAGIC, sizeof(header.magic));
+    header.version = DA_FILE_VERSION;
+    header.byteOrder = DA_FILE_BYTE_ORDER;
+    header.elementSize = (*(char **)daptr) ? (unsigned long long)dynValuesToArray((char **)daptr)->elementSize : sizeof(char*);
+    header.count = (unsigned long long)count;
+    header.dataOffset = DA_FILE_DATA_OFFSET;
+
+    f = fopen(path, "wb");
+    if(!f)
+        return 0;
+    ok = (fwrite(&header, sizeof(header), 1, f) == 1)
+      && (fwrite(zeros, DA_FILE_DATA_OFFSET - sizeof(header), 1, f) == 1);
+    if(ok && (count > 0))
+    {
+        // a wrapped deque goes out as its two runs; the array itself is left where it is
+        char *runs[2];
+        dynSize counts[2];
+        int runCount = daRuns(dynValuesToArray((char **)daptr), 0, count, runs, counts);
+        int i;
+        for(i = 0; ok && (i < runCount); ++i)
+            ok = (fwrite(runs[i], (size_t)header.elementSize, (size_t)counts[i], f) == (size_t)counts[i]);
+    }
+    if(fclose(f) != 0)
+        ok = 0;
+    return ok;
+}
+
+int daMapFile(void *daptr, const char *path, int flags)
+{
+    dynFileHeader header;
+    dynArray *da;
+    unsigned long long fileBytes = 0;
+    char *base;
+
+    daDestroy(daptr, NULL);
+    base = dynFileMap(path, &fileBytes);
+    if(!base)
+        return 0;
+
+    memcpy(&header, base, sizeof(header));
+    if((memcmp(header.magic, DA_FILE_MAGIC, sizeof(header.magic)) != 0)
+       || (header.version != DA_FILE_VERSION)
+       || (header.byteOrder != DA_FILE_BYTE_ORDER)
+       || (header.dataOffset != DA_FILE_DATA_OFFSET)
+       || (header.elementSize == 0)
+       || (header.elementSize > (unsigned long long)dynSizeMax)
+       || (header.count > ((unsigned long long)dynSizeMax / header.elementSize))
+       || (fileBytes != (header.dataOffset + (header.elementSize * header.count))))
+    {
+        dynFileUnmapRange(base, (size_t)fileBytes);
+        return 0;
+    }
+
+    // The header goes in the (private, now dirty) page just before the values; the values
+    // themselves stay shared with the page cache until something writes to them.
+    da = (dynArray *)(base + DA_FILE_DATA_OFFSET - dynArrayHeaderSize);
+    memset(da, 0, dynArrayHeaderSize);
+    da->elementSize = (dynSize)header.elementSize;
+    da->size = (dynSize)header.count;
+    da->capacity = da->size;
+    da->flags = DAF_MAPPED;
+    if(!(flags & DA_MAP_WRITABLE))
+    {
+        da->flags |= DAF_READONLY;
+        dynFileProtect(base, DA_FILE_DATA_OFFSET + (size_t)(header.elementSize * header.count));
+    }
+    *(char **)daptr = dynArrayToValues(da);
+    return 1;
+}
+
+void dynFileUnmap(dynArray *da)
+{
+    char *base = dynArrayToValues(da) - DA_FILE_DATA_OFFSET;
+    dynFileUnmapRange(base, DA_FILE_DATA_OFFSET + ((size_t)da->capacity * da->elementSize));
+}
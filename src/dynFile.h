@@ -0,0 +1,19 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#ifndef DYN_FILE_H
+#define DYN_FILE_H
+
+// Glue between dynArray and the file mapping code. This is an internal header; it is not
+// installed alongside dyn.h.
+
+#include "dyn.h"
+
+// Releases a DAF_MAPPED array's whole mapping (header included)
+void dynFileUnmap(dynArray *da);
+
+#endif
@@ -0,0 +1,345 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "dyn.h"
+#include "dynSlots.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ------------------------------------------------------------------------------------------------
+// Constants and Macros
+
+// A 4-ary heap is half as deep as a binary one, and the four children of a node are adjacent, so
+// a sift down reads one or two cache lines per level instead of bouncing around. Pushes (sift up)
+// get cheaper too; pops do a few more compares per level, but over far fewer levels.
+#define HEAP_ARITY 4
+
+#define heapParent(INDEX) (((INDEX) - 1) / HEAP_ARITY)
+#define heapFirstChild(INDEX) (((INDEX) * HEAP_ARITY) + 1)
+
+#define HOLE_BUFFER_SIZE 64 // elements bigger than this get a heap-allocated hole buffer
+
+#define elementAt(BASE, INDEX, SIZE) ((BASE) + ((INDEX) * (SIZE)))
+
+// ------------------------------------------------------------------------------------------------
+// Internal structures
+
+typedef struct dynHeap
+{
+    char *values;
+    dynSize elementSize;
+    dynCompareFunc compare;
+    char *hole; // one element of scratch space
+} dynHeap;
+
+// ------------------------------------------------------------------------------------------------
+// Internal helper functions
+
+// Linearizes the (already created) array and fills in heap
+static dynArray *heapInit(dynHeap *heap, void *daptr, void *compareFunc, char *holeBuffer)
+{
+    dynArray *da;
+    daUnshare(daptr);
+    daLinearize(daptr);
+    da = dynValuesToArray((char **)daptr);
+    heap->values = *(char **)daptr;
+    heap->elementSize = da->elementSize;
+    heap->compare = (dynCompareFunc)compareFunc;
+    heap->hole = (da->elementSize > HOLE_BUFFER_SIZE) ? (char *)malloc(da->elementSize) : holeBuffer;
+    return da;
+}
+
+static void heapFinish(dynHeap *heap, char *holeBuffer)
+{
+    if(heap->hole != holeBuffer)
+        free(heap->hole);
+}
+
+// Moves the element at index up to where it belongs, sliding parents down into the hole it leaves
+static void heapSiftUp(dynHeap *heap, dynSize index)
+{
+    dynSize elementSize = heap->elementSize;
+    memcpy(heap->hole, elementAt(heap->values, index, elementSize), elementSize);
+    while(index > 0)
+    {
+        dynSize parent = heapParent(index);
+        if(heap->compare(heap->hole, elementAt(heap->values, parent, elementSize)) >= 0)
+            break;
+        memcpy(elementAt(heap->values, index, elementSize), elementAt(heap->values, parent, elementSize), elementSize);
+        index = parent;
+    }
+    memcpy(elementAt(heap->values, index, elementSize), heap->hole, elementSize);
+}
+
+// Moves the element at index down (within the first count elements), pulling the smallest child up
+static void heapSiftDown(dynHeap *heap, dynSize index, dynSize count)
+{
+    dynSize elementSize = heap->elementSize;
+    memcpy(heap->hole, elementAt(heap->values, index, elementSize), elementSize);
+    for(;;)
+    {
+        dynSize first = heapFirstChild(index);
+        dynSize last = first + HEAP_ARITY;
+        dynSize best = first;
+        dynSize child;
+        if(first >= count)
+            break;
+        if(last > count)
+            last = count;
+        for(child = first + 1; child < last; ++child)
+        {
+            if(heap->compare(elementAt(heap->values, child, elementSize), elementAt(heap->values, best, elementSize)) < 0)
+                best = child;
+        }
+        if(heap->compare(elementAt(heap->values, best, elementSize), heap->hole) >= 0)
+            break;
+        memcpy(elementAt(heap->values, index, elementSize), elementAt(heap->values, best, elementSize), elementSize);
+        index = best;
+    }
+    memcpy(elementAt(heap->values, index, elementSize), heap->hole, elementSize);
+}
+
+// The same heap, specialized for plain numeric keys so the compares inline
+#define HEAP_FUNCS(SUFFIX, TYPE)                                                             \
+static void heapSiftUp ## SUFFIX(TYPE *v, dynSize index)                                     \
+{                                                                                            \
+    TYPE hole = v[index];                                                                    \
+    while(index > 0)                                                                         \
+    {                                                                                        \
+        dynSize parent = heapParent(index);                                                  \
+        if(!(hole < v[parent]))                                                              \
+            break;                                                                           \
+        v[index] = v[parent];                                                                \
+        index = parent;                                                                      \
+    }                                                                                        \
+    v[index] = hole;                                                                         \
+}                                                                                            \
+                                                                                             \
+static void heapSiftDown ## SUFFIX(TYPE *v, dynSize index, dynSize count)                    \
+{                                                                                            \
+    TYPE hole = v[index];                                                                    \
+    for(;;)                                                                                  \
+    {                                                                                        \
+        dynSize first = heapFirstChild(index);                                               \
+        dynSize last = first + HEAP_ARITY;                                                   \
+        dynSize best = first;                                                                \
+        dynSize child;                                                                       \
+        if(first >= count)                                                                   \
+            break;                                                                           \
+        if(last > count)                                                                     \
+            last = count;                                                                    \
+        for(child = first + 1; child < last; ++child)                                        \
+        {                                                                                    \
+            if(v[child] < v[best])                                                           \
+                best = child;                                                                \
+        }                                                                                    \
+        if(!(v[best] < hole))                                                                \
+            break;                                                                           \
+        v[index] = v[best];                                                                  \
+        index = best;                                                                        \
+    }                                                                                        \
+    v[index] = hole;                                                                         \
+}                                                                                            \
+                                                                                             \
+void daHeapify ## SUFFIX(void *daptr)                                                        \
+{                                                                                            \
+    dynSize count = daSize(daptr);                                                           \
+    dynSize i;                                                                               \
+    if(count < 2)                                                                            \
+        return;                                                                              \
+    daUnshare(daptr);                                                                        \
+    daLinearize(daptr);                                                                      \
+    for(i = heapParent(count - 1) + 1; i-- > 0; )                                            \
+        heapSiftDown ## SUFFIX(*(TYPE **)daptr, i, count);                                   \
+}                                                                                            \
+                                                                                             \
+void daHeapPush ## SUFFIX(void *daptr, TYPE value)                                           \
+{                                                                                            \
+    dynSize index = daPush ## SUFFIX(daptr, value);                                          \
+    daLinearize(daptr);                                                                      \
+    heapSiftUp ## SUFFIX(*(TYPE **)daptr, index);                                            \
+}                                                                                            \
+                                                                                             \
+int daHeapPop ## SUFFIX(void *daptr, TYPE *out)                                              \
+{                                                                                            \
+    dynArray *da;                                                                            \
+    TYPE *v;                                                                                 \
+    if(daSize(daptr) == 0)                                                                   \
+        return 0;                                                                            \
+    daUnshare(daptr);                                                                        \
+    daLinearize(daptr);                                                                      \
+    da = dynValuesToArray((char **)daptr);                                                   \
+    v = *(TYPE **)daptr;                                                                     \
+    if(out)                                                                                  \
+        *out = v[0];                                                                         \
+    --da->size;                                                                              \
+    if(da->size > 0)                                                                         \
+    {                                                                                        \
+        v[0] = v[da->size];                                                                  \
+        heapSiftDown ## SUFFIX(v, 0, da->size);                                              \
+    }                                                                                        \
+    return 1;                                                                                \
+}                                                                                            \
+                                                                                             \
+int daHeapPushBounded ## SUFFIX(void *daptr, TYPE value, dynSize maxSize)                    \
+{                                                                                            \
+    TYPE *v;                                                                                 \
+    if(maxSize <= 0)                                                                         \
+        return 0;                                                                            \
+    if(daSize(daptr) < maxSize)                                                              \
+    {                                                                                        \
+        daHeapPush ## SUFFIX(daptr, value);                                                  \
+        return 1;                                                                            \
+    }                                                                                        \
+    daUnshare(daptr);                                                                        \
+    daLinearize(daptr);                                                                      \
+    v = *(TYPE **)daptr;                                                                     \
+    if(!(v[0] < value))                                                                      \
+        return 0;                                                                            \
+    v[0] = value;                                                                            \
+    heapSiftDown ## SUFFIX(v, 0, daSize(daptr));                                             \
+    return 1;                                                                                \
+}
+
+// ------------------------------------------------------------------------------------------------
+// Heaps
+
+void daHeapify(void *daptr, void * /*dynCompareFunc*/ compareFunc)
+{
+    dynHeap heap;
+    char holeBuffer[HOLE_BUFFER_SIZE];
+    dynSize count = daSize(daptr);
+    dynSize i;
+    if(count < 2)
+        return;
+
+    heapInit(&heap, daptr, compareFunc, holeBuffer);
+    for(i = heapParent(count - 1) + 1; i-- > 0; )
+        heapSiftDown(&heap, i, count);
+    heapFinish(&heap, holeBuffer);
+}
+
+void daHeapPush(void *daptr, const void *element, void * /*dynCompareFunc*/ compareFunc)
+{
+    dynHeap heap;
+    char holeBuffer[HOLE_BUFFER_SIZE];
+    dynSize index = daPushIndirect(daptr, (void *)element);
+    heapInit(&heap, daptr, compareFunc, holeBuffer);
+    heapSiftUp(&heap, index);
+    heapFinish(&heap, holeBuffer);
+}
+
+int daHeapPop(void *daptr, void *out, void * /*dynCompareFunc*/ compareFunc)
+{
+    dynHeap heap;
+    char holeBuffer[HOLE_BUFFER_SIZE];
+    dynArray *da;
+    if(daSize(daptr) == 0)
+        return 0;
+
+    da = heapInit(&heap, daptr, compareFunc, holeBuffer);
+    if(out)
+        memcpy(out, heap.values, heap.elementSize);
+    --da->size;
+    if(da->size > 0)
+    {
+        memcpy(heap.values, elementAt(heap.values, da->size, heap.elementSize), heap.elementSize);
+        heapSiftDown(&heap, 0, da->size);
+    }
+    heapFinish(&heap, holeBuffer);
+    return 1;
+}
+
+int daHeapPushBounded(void *daptr, const void *element, dynSize maxSize, void * /*dynCompareFunc*/ compareFunc)
+{
+    dynHeap heap;
+    char holeBuffer[HOLE_BUFFER_SIZE];
+    if(maxSize <= 0)
+        return 0;
+    if(daSize(daptr) < maxSize)
+    {
+        daHeapPush(daptr, element, compareFunc);
+        return 1;
+    }
+
+    // Full: the new element only gets in if it beats the smallest one kept so far
+    heapInit(&heap, daptr, compareFunc, holeBuffer);
+    if(heap.compare(element, heap.values) <= 0)
+    {
+        heapFinish(&heap, holeBuffer);
+        return 0;
+    }
+    memcpy(heap.values, element, heap.elementSize);
+    heapSiftDown(&heap, 0, daSize(daptr));
+    heapFinish(&heap, holeBuffer);
+    return 1;
+}
+
+void daTopK(void *dstptr, void *srcptr, dynSize k, void * /*dynCompareFunc*/ compareFunc)
+{
+    dynHeap heap;
+    char holeBuffer[HOLE_BUFFER_SIZE];
+    char topBuffer[HOLE_BUFFER_SIZE];
+    char *top;
+    char *runs[2];
+    dynSize counts[2];
+    dynArray *src = *(char **)srcptr ? dynValuesToArray((char **)srcptr) : NULL;
+    dynSize keep, count, seen, i;
+    int runCount, run;
+
+    if(*(char **)dstptr && src && (dynValuesToArray((char **)dstptr)->elementSize != src->elementSize))
+        daDestroy(dstptr, NULL);
+    daClear(dstptr, NULL);
+    if(!src || (k <= 0))
+        return;
+    daCreate(dstptr, src->elementSize);
+    keep = (k < src->size) ? k : src->size;
+    if(keep == 0)
+        return;
+
+    // dst is sized once, so one heapInit() covers the whole pass. src is only read, so a wrapped
+    // deque is walked as its two runs rather than linearized (others may be reading it too).
+    daPushUninit(dstptr, keep);
+    heapInit(&heap, dstptr, compareFunc, holeBuffer);
+    runCount = daRuns(src, 0, src->size, runs, counts);
+    seen = 0;
+    for(run = 0; run < runCount; ++run)
+    {
+        for(i = 0; i < counts[run]; ++i, ++seen)
+        {
+            const char *element = elementAt(runs[run], i, heap.elementSize);
+            if(seen < keep)
+            {
+                memcpy(elementAt(heap.values, seen, heap.elementSize), element, heap.elementSize);
+                heapSiftUp(&heap, seen);
+            }
+            else if(heap.compare(element, heap.values) > 0)
+            {
+                // beats the smallest one kept so far
+                memcpy(heap.values, element, heap.elementSize);
+                heapSiftDown(&heap, 0, keep);
+            }
+        }
+    }
+
+    // Heap sort the survivors; with a min-heap that leaves them largest first
+    top = (heap.elementSize > HOLE_BUFFER_SIZE) ? (char *)malloc(heap.elementSize) : topBuffer;
+    for(count = keep - 1; count > 0; --count)
+    {
+        memcpy(top, heap.values, heap.elementSize);
+        memcpy(heap.values, elementAt(heap.values, count, heap.elementSize), heap.elementSize);
+        heapSiftDown(&heap, 0, count);
+        memcpy(elementAt(heap.values, count, heap.elementSize), top, heap.elementSize);
+    }
+    if(top != topBuffer)
+        free(top);
+    heapFinish(&heap, holeBuffer);
+}
+
+HEAP_FUNCS(U32, dynU32)
+HEAP_FUNCS(F32, dynF32)
@@ -46,6 +46,23 @@ static unsigned int djb2int(dynInt i);
 #define INITIAL_MODULUS 2  // "N" on Wikipedia's explanation of linear hashes
 #define SHRINK_FACTOR   4  // How many times bigger does the table capacity have to be to its
                            // width to cause the table to shrink?
+#define SLAB_MIN_BYTES  (64 * 1024) // Smallest slab an incremental compaction will allocate
+#define SLAB_ALIGN      8
+
+#define slabAlign(bytes) (((bytes) + (SLAB_ALIGN - 1)) & ~(dynSize)(SLAB_ALIGN - 1))
+#define slabData(slab) ((char *)(slab) + slabAlign(sizeof(dynMapSlab)))
+
+// ------------------------------------------------------------------------------------------------
+// Internal structures
+
+// A single block holding many relocated entries, each immediately followed by its data and then
+// (for owned string keys) its key. It is freed once the last entry living in it goes away.
+typedef struct dynMapSlab
+{
+    dynSize capacity; // bytes available after the header
+    dynSize used;
+    dynSize live;     // entries currently living in this slab
+} dynMapSlab;
 
 // ------------------------------------------------------------------------------------------------
 // Internal helper functions
@@ -56,7 +73,9 @@ static dynSize linearHashCompute(dynMap *dm, dynMapHash hash)
     // "the split" (putting it in the front partition instead of the expansion),
     // rehash with the next-size-up modulus.
 
-    dynSize addr = hash % dm->mod;
+    dynSize addr;
+    hash >>= dm->hashShift;
+    addr = hash % dm->mod;
     if(addr < dm->split)
     {
         addr = hash % (dm->mod << 1);
@@ -71,7 +90,7 @@ static void dmBucketEntryChain(dynMap *dm, dynMapEntry *chain)
     while(chain)
     {
         dynMapEntry *entry = chain;
-        dynInt tableIndex = linearHashCompute(dm, entry->hash);
+        dynSize tableIndex = linearHashCompute(dm, entry->hash);
         chain = chain->next;
 
         entry->next = dm->table[tableIndex];
@@ -175,6 +194,7 @@ void dmDestroyIndirect(dynMap *dm, void * /*dynDestroyFunc*/ destroyFunc)
     {
         dmClearIndirect(dm, destroyFunc);
         daDestroyIndirect(&dm->table, NULL);
+        daDestroy(&dm->slabs, NULL);
         free(dm);
     }
 }
@@ -185,12 +205,62 @@ void dmDestroy(dynMap *dm, void * /*dynDestroyFunc*/ destroyFunc)
     {
         dmClear(dm, destroyFunc);
         daDestroyIndirect(&dm->table, NULL);
+        daDestroy(&dm->slabs, NULL);
+        free(dm);
+    }
+}
+
+void dmDestroyBatchIndirect(dynMap *dm, void * /*dynDestroyBatchFunc*/ destroyFunc)
+{
+    if(dm)
+    {
+        dmClearBatchIndirect(dm, destroyFunc);
+        daDestroyIndirect(&dm->table, NULL);
+        daDestroy(&dm->slabs, NULL);
+        free(dm);
+    }
+}
+
+void dmDestroyBatch(dynMap *dm, void * /*dynDestroyBatchFunc*/ destroyFunc)
+{
+    if(dm)
+    {
+        dmClearBatch(dm, destroyFunc);
+        daDestroyIndirect(&dm->table, NULL);
+        daDestroy(&dm->slabs, NULL);
         free(dm);
     }
 }
 
+// Entries remember their slab's serial, so this is O(1). Slabs that empty out are freed but keep
+// their place (as NULL) so later serials stay put; dead ones at the front are dropped for good.
+static void dmSlabRelease(dynMap *dm, dynMapEntry *p)
+{
+    dynSize slabIndex = (p->slab - 1) - dm->slabBase;
+    dynMapSlab *slab = dm->slabs[slabIndex];
+    --slab->live;
+    if(slab->live == 0)
+    {
+        dynSize deadCount = 0;
+        free(slab);
+        dm->slabs[slabIndex] = NULL;
+        while((deadCount < daSize(&dm->slabs)) && !dm->slabs[deadCount])
+            ++deadCount;
+        if(deadCount > 0)
+        {
+            daEraseRange(&dm->slabs, 0, deadCount);
+            dm->slabBase += deadCount;
+        }
+    }
+}
+
 static void dmDestroyEntry(dynMap *dm, dynMapEntry *p)
 {
+    if(p->slab)
+    {
+        dmSlabRelease(dm, p);
+        return;
+    }
     if((dm->flags & (DKF_STRING|DKF_UNOWNED_KEYS)) == DKF_STRING) // string map with owned keys?
     {
         free(p->keyStr);
@@ -203,7 +273,7 @@ static void dmClearInternal(dynMap *dm, void * /*dynDestroyFunc*/ destroyFunc, i
     dynDestroyFunc func = destroyFunc;
     if(dm)
     {
-        dynInt tableIndex;
+        dynSize tableIndex;
         for(tableIndex = 0; tableIndex < daSize(&dm->table); ++tableIndex)
         {
             dynMapEntry *entry = dm->table[tableIndex];
@@ -224,11 +294,58 @@ static void dmClearInternal(dynMap *dm, void * /*dynDestroyFunc*/ destroyFunc, i
                     }
                 }
                 entry = entry->next;
-                dmDestroyEntry(dm, freeme);
+                if(!freeme->slab) // slabs are all freed in one go below
+                    dmDestroyEntry(dm, freeme);
             }
         }
         memset(dm->table, 0, daSize(&dm->table) * sizeof(dynMapEntry*));
+        daClear(&dm->slabs, free);
+        dm->count = 0;
+        dm->slabBase = 0;
+        dm->compacting = 0;
+        dm->compactFirstSlab = 0;
+    }
+}
+
+// Gathers every entry's data (or the pointer stored there) into a small buffer and hands it to
+// destroyFunc a batch at a time. Entries are freed afterwards by dmClearInternal(), since the
+// indirect pointers point into them.
+static void dmDestroyBatched(dynMap *dm, void * /*dynDestroyBatchFunc*/ destroyFunc, int ptrs)
+{
+    dynDestroyBatchFunc func = destroyFunc;
+    void *batch[DM_DESTROY_BATCH];
+    dynSize batchCount = 0;
+    dynSize tableIndex;
+    for(tableIndex = 0; tableIndex < daSize(&dm->table); ++tableIndex)
+    {
+        dynMapEntry *entry = dm->table[tableIndex];
+        for( ; entry; entry = entry->next)
+        {
+            void *data = dmEntryData(entry);
+            batch[batchCount++] = ptrs ? *((void **)data) : data;
+            if(batchCount == DM_DESTROY_BATCH)
+            {
+                func(batch, batchCount);
+                batchCount = 0;
+            }
+        }
     }
+    if(batchCount > 0)
+        func(batch, batchCount);
+}
+
+void dmClearBatchIndirect(dynMap *dm, void * /*dynDestroyBatchFunc*/ destroyFunc)
+{
+    if(dm && destroyFunc)
+        dmDestroyBatched(dm, destroyFunc, 0);
+    dmClearInternal(dm, NULL, 0);
+}
+
+void dmClearBatch(dynMap *dm, void * /*dynDestroyBatchFunc*/ destroyFunc)
+{
+    if(dm && destroyFunc)
+        dmDestroyBatched(dm, destroyFunc, 1);
+    dmClearInternal(dm, NULL, 0);
 }
 
 void dmClearIndirect(dynMap *dm, void * /*dynDestroyFunc*/ destroyFunc)
@@ -241,10 +358,9 @@ void dmClear(dynMap *dm, void * /*dynDestroyFunc*/ destroyFunc)
     dmClearInternal(dm, destroyFunc, 1);
 }
 
-static dynMapEntry *dmFindString(dynMap *dm, const char *key, int autoCreate)
+static dynMapEntry *dmFindStringHashed(dynMap *dm, const char *key, dynMapHash hash, int autoCreate)
 {
-    dynMapHash hash = (dynMapHash)HASHSTRING(key);
-    dynInt index = linearHashCompute(dm, hash);
+    dynSize index = linearHashCompute(dm, hash);
     dynMapEntry *entry = dm->table[index];
     for( ; entry; entry = entry->next)
     {
@@ -260,10 +376,9 @@ static dynMapEntry *dmFindString(dynMap *dm, const char *key, int autoCreate)
     return NULL;
 }
 
-static dynMapEntry *dmFindInteger(dynMap *dm, dynInt key, int autoCreate)
+static dynMapEntry *dmFindIntegerHashed(dynMap *dm, dynInt key, dynMapHash hash, int autoCreate)
 {
-    dynMapHash hash = (dynMapHash)HASHINT(key);
-    dynInt index = linearHashCompute(dm, hash);
+    dynSize index = linearHashCompute(dm, hash);
     dynMapEntry *entry = dm->table[index];
     for( ; entry; entry = entry->next)
     {
@@ -279,6 +394,16 @@ static dynMapEntry *dmFindInteger(dynMap *dm, dynInt key, int autoCreate)
     return NULL;
 }
 
+static dynMapEntry *dmFindString(dynMap *dm, const char *key, int autoCreate)
+{
+    return dmFindStringHashed(dm, key, (dynMapHash)HASHSTRING(key), autoCreate);
+}
+
+static dynMapEntry *dmFindInteger(dynMap *dm, dynInt key, int autoCreate)
+{
+    return dmFindIntegerHashed(dm, key, (dynMapHash)HASHINT(key), autoCreate);
+}
+
 dynMapEntry *dmGetString(dynMap *dm, const char *key)
 {
     return dmFindString(dm, key, 1);
@@ -293,7 +418,7 @@ void dmEraseString(dynMap *dm, const char *key, void * /*dynDestroyFunc*/ destro
 {
     dynDestroyFunc func = destroyFunc;
     dynMapHash hash = (dynMapHash)HASHSTRING(key);
-    dynInt index = linearHashCompute(dm, hash);
+    dynSize index = linearHashCompute(dm, hash);
     dynMapEntry *prev = NULL;
     dynMapEntry *entry = dm->table[index];
     for( ; entry; prev = entry, entry = entry->next)
@@ -333,7 +458,7 @@ void dmEraseInteger(dynMap *dm, dynInt key, void * /*dynDestroyFunc*/ destroyFun
 {
     dynDestroyFunc func = destroyFunc;
     dynMapHash hash = (dynMapHash)HASHINT(key);
-    dynInt index = linearHashCompute(dm, hash);
+    dynSize index = linearHashCompute(dm, hash);
     dynMapEntry *prev = NULL;
     dynMapEntry *entry = dm->table[index];
     for( ; entry; prev = entry, entry = entry->next)
@@ -367,8 +492,8 @@ void dmEraseInteger(dynMap *dm, dynInt key, void * /*dynDestroyFunc*/ destroyFun
 void dmIterate(dynMap *dm, /* dynMapIterateFunc */ void *func, void *userData)
 {
     dynMapIterateFunc itFunc = (dynMapIterateFunc)func;
-    int bucketCount = dm->split + dm->mod;
-    int i;
+    dynSize bucketCount = dm->split + dm->mod;
+    dynSize i;
     for(i = 0; i < bucketCount; ++i)
     {
         dynMapEntry *entry = dm->table[i];
@@ -379,6 +504,327 @@ void dmIterate(dynMap *dm, /* dynMapIterateFunc */ void *func, void *userData)
     }
 }
 
+// ------------------------------------------------------------------------------------------------
+// Compaction
+
+static dynSize dmEntryFootprint(dynMap *dm, dynMapEntry *entry)
+{
+    dynSize bytes = sizeof(dynMapEntry) + dm->elementSize;
+    if((dm->flags & (DKF_STRING|DKF_UNOWNED_KEYS)) == DKF_STRING)
+        bytes += (dynSize)strlen(entry->keyStr) + 1;
+    return slabAlign(bytes);
+}
+
+static dynMapSlab *dmSlabCreate(dynMap *dm, dynSize capacity)
+{
+    dynMapSlab *slab = (dynMapSlab *)malloc(slabAlign(sizeof(dynMapSlab)) + capacity);
+    slab->capacity = capacity;
+    slab->used = 0;
+    slab->live = 0;
+    daPush(&dm->slabs, slab);
+    return slab;
+}
+
+// exactBytes > 0 reserves a single slab big enough for the whole pass
+static void dmCompactBegin(dynMap *dm, dynSize exactBytes)
+{
+    dm->compacting = 1;
+    dm->compactCursor = 0;
+    dm->compactFirstSlab = dm->slabBase + daSize(&dm->slabs);
+    if(exactBytes > 0)
+        dmSlabCreate(dm, exactBytes);
+}
+
+// Returns true if the entry was already relocated by the in-progress compaction
+static int dmCompactMoved(dynMap *dm, dynMapEntry *entry)
+{
+    return entry->slab && ((entry->slab - 1) >= dm->compactFirstSlab);
+}
+
+static dynMapEntry *dmCompactRelocate(dynMap *dm, dynMapEntry *entry)
+{
+    dynSize footprint = dmEntryFootprint(dm, entry);
+    dynSize entryBytes = sizeof(dynMapEntry) + dm->elementSize;
+    dynMapSlab *slab = NULL;
+    dynMapEntry *newEntry;
+
+    // Only keep filling the newest slab if this pass created it; it may have emptied out (NULL), and
+    // if every slab has, there's no newest slab at all
+    if((daSize(&dm->slabs) > 0) && ((dm->slabBase + daSize(&dm->slabs) - 1) >= dm->compactFirstSlab))
+        slab = dm->slabs[daSize(&dm->slabs) - 1];
+    if(!slab || ((slab->capacity - slab->used) < footprint))
+    {
+        // Guess at what the rest of the pass needs, growing geometrically if we keep guessing low
+        dynSize capacity = footprint * (dm->count > 0 ? dm->count : 1);
+        if(slab && (capacity < (slab->capacity * 2)))
+            capacity = slab->capacity * 2;
+        if(capacity < SLAB_MIN_BYTES)
+            capacity = SLAB_MIN_BYTES;
+        if(capacity < footprint)
+            capacity = footprint;
+        slab = dmSlabCreate(dm, capacity);
+    }
+
+    newEntry = (dynMapEntry *)(slabData(slab) + slab->used);
+    memcpy(newEntry, entry, entryBytes);
+    if((dm->flags & (DKF_STRING|DKF_UNOWNED_KEYS)) == DKF_STRING)
+    {
+        newEntry->keyStr = (char *)newEntry + entryBytes;
+        strcpy(newEntry->keyStr, entry->keyStr);
+    }
+    newEntry->slab = dm->slabBase + daSize(&dm->slabs); // 1 + the serial of the newest slab, which is this one
+    slab->used += footprint;
+    ++slab->live;
+
+    dmDestroyEntry(dm, entry);
+    return newEntry;
+}
+
+void dmCompact(dynMap *dm)
+{
+    if(!dm->compacting)
+    {
+        dynSize bytes = 0;
+        dynSize tableIndex;
+        dynSize bucketCount = dm->split + dm->mod;
+        for(tableIndex = 0; tableIndex < bucketCount; ++tableIndex)
+        {
+            dynMapEntry *entry = dm->table[tableIndex];
+            for( ; entry; entry = entry->next)
+                bytes += dmEntryFootprint(dm, entry);
+        }
+        dmCompactBegin(dm, bytes);
+    }
+    dmCompactStep(dm, 0);
+}
+
+int dmCompactStep(dynMap *dm, dynSize maxEntries)
+{
+    dynSize moved = 0;
+    if(!dm->compacting)
+        dmCompactBegin(dm, 0);
+
+    // Buckets are handled whole, so a step may overshoot maxEntries by one chain's worth
+    while(dm->compactCursor < (dm->split + dm->mod))
+    {
+        dynMapEntry **link = &dm->table[dm->compactCursor];
+        for( ; *link; link = &(*link)->next)
+        {
+            if(!dmCompactMoved(dm, *link))
+            {
+                *link = dmCompactRelocate(dm, *link);
+                ++moved;
+            }
+        }
+        ++dm->compactCursor;
+        if((maxEntries > 0) && (moved >= maxEntries))
+            break;
+    }
+
+    if(dm->compactCursor >= (dm->split + dm->mod))
+    {
+        dm->compacting = 0;
+        return 1;
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Parallel building / merging
+
+typedef struct dmParallelBuildJob
+{
+    dynMap *dm;             // the final map
+    dynMap **partitions;    // one sub-map per partition
+    dynMapHash *hashes;     // precomputed hash for every key
+    dynSize **buckets;      // dynArray of key indices for every (thread, partition) pair
+    const void *keys;
+    dynSize keyCount;
+    dynMapBuildFunc func;
+    void *userData;
+    int partitionCount;     // always a power of two
+    int threadCount;
+} dmParallelBuildJob;
+
+// Hashes a slice of the keys, and sorts their indices by partition on the way: the low bits of
+// the hash pick the partition, so every bucket a partition owns in the final table shares them
+static void dmParallelBuildHash(int threadIndex, dmParallelBuildJob *job)
+{
+    dynSize start = (dynSize)(((long long)job->keyCount * threadIndex) / job->threadCount);
+    dynSize end = (dynSize)(((long long)job->keyCount * (threadIndex + 1)) / job->threadCount);
+    dynSize **buckets = job->buckets + ((dynSize)threadIndex * job->partitionCount);
+    dynMapHash mask = (dynMapHash)(job->partitionCount - 1);
+    dynSize i;
+    if(job->dm->flags & DKF_INTEGER)
+    {
+        const dynInt *keys = (const dynInt *)job->keys;
+        for(i = start; i < end; ++i)
+            job->hashes[i] = (dynMapHash)HASHINT(keys[i]);
+    }
+    else
+    {
+        const char **keys = (const char **)job->keys;
+        for(i = start; i < end; ++i)
+            job->hashes[i] = (dynMapHash)HASHSTRING(keys[i]);
+    }
+    for(i = start; i < end; ++i)
+        *(dynSize *)daPushUninit(&buckets[job->hashes[i] & mask], 1) = i;
+}
+
+// Builds each owned partition's sub-map from the indices gathered above. Thread slices are visited
+// in order, so keys still reach func in their original order. The sub-maps drop the partition
+// bits before bucketing (hashShift), as they're the same for every key in them.
+static void dmParallelBuildPartitions(int threadIndex, dmParallelBuildJob *job)
+{
+    int partitionIndex, sliceIndex;
+    dynSize j;
+    for(partitionIndex = threadIndex; partitionIndex < job->partitionCount; partitionIndex += job->threadCount)
+    {
+        dynMap *sub = job->partitions[partitionIndex];
+        for(sliceIndex = 0; sliceIndex < job->threadCount; ++sliceIndex)
+        {
+            dynSize **indices = &job->buckets[((dynSize)sliceIndex * job->partitionCount) + partitionIndex];
+            for(j = 0; j < daSize(indices); ++j)
+            {
+                dynSize i = (*indices)[j];
+                dynMapEntry *entry;
+                if(sub->flags & DKF_INTEGER)
+                    entry = dmFindIntegerHashed(sub, ((const dynInt *)job->keys)[i], job->hashes[i], 1);
+                else
+                    entry = dmFindStringHashed(sub, ((const char **)job->keys)[i], job->hashes[i], 1);
+                if(job->func)
+                    job->func(entry, i, job->userData);
+            }
+        }
+    }
+}
+
+// Moves every entry of a partition's sub-map into the final table. As the final modulus is a
+// power of two no smaller than the partition count, each partition only ever lands in buckets
+// whose low bits match the partition index, so partitions can be stitched in concurrently.
+static void dmParallelBuildStitch(int threadIndex, dmParallelBuildJob *job)
+{
+    int partitionIndex;
+    dynSize tableIndex;
+    for(partitionIndex = threadIndex; partitionIndex < job->partitionCount; partitionIndex += job->threadCount)
+    {
+        dynMap *sub = job->partitions[partitionIndex];
+        for(tableIndex = 0; tableIndex < daSize(&sub->table); ++tableIndex)
+        {
+            dynMapEntry *chain = sub->table[tableIndex];
+            sub->table[tableIndex] = NULL;
+            dmBucketEntryChain(job->dm, chain);
+        }
+        sub->count = 0;
+    }
+}
+
+dynMap *dmParallelBuild(dmKeyFlags flags, dynSize elementSize, const void *keys, dynSize keyCount, void * /*dynMapBuildFunc*/ func, void *userData, int threadCount)
+{
+    dmParallelBuildJob job;
+    dynSize totalCount = 0;
+    dynSize bucketCount;
+    int i, shift;
+
+    if(threadCount < 1)
+        threadCount = dtCPUCount();
+
+    memset(&job, 0, sizeof(job));
+    job.dm = dmCreate(flags, elementSize);
+    job.keys = keys;
+    job.keyCount = keyCount;
+    job.func = (dynMapBuildFunc)func;
+    job.userData = userData;
+    job.threadCount = threadCount;
+    job.partitionCount = 1;
+    while(job.partitionCount < threadCount)
+        job.partitionCount <<= 1;
+
+    job.hashes = (dynMapHash *)malloc(sizeof(dynMapHash) * (keyCount ? keyCount : 1));
+    job.partitions = (dynMap **)calloc(job.partitionCount, sizeof(dynMap *));
+    job.buckets = (dynSize **)calloc((size_t)job.partitionCount * threadCount, sizeof(dynSize *));
+    for(i = 0; i < job.partitionCount; ++i)
+    {
+        job.partitions[i] = dmCreate(flags, elementSize);
+        for(shift = 1; shift < job.partitionCount; shift <<= 1)
+            ++job.partitions[i]->hashShift;
+    }
+    for(i = 0; i < (job.partitionCount * threadCount); ++i)
+    {
+        daCreate(&job.buckets[i], sizeof(dynSize));
+    }
+
+    dtRun(threadCount, dmParallelBuildHash, &job);
+    dtRun(threadCount, dmParallelBuildPartitions, &job);
+    for(i = 0; i < (job.partitionCount * threadCount); ++i)
+    {
+        daDestroy(&job.buckets[i], NULL);
+    }
+    free(job.buckets);
+
+    // Size the final table up front, exactly as if every entry had gone through dmNewEntry
+    for(i = 0; i < job.partitionCount; ++i)
+    {
+        totalCount += job.partitions[i]->count;
+    }
+    bucketCount = INITIAL_MODULUS + totalCount;
+    while((job.dm->mod << 1) <= bucketCount)
+        job.dm->mod <<= 1;
+    job.dm->split = bucketCount - job.dm->mod;
+    job.dm->count = totalCount;
+    daSetSize(&job.dm->table, job.dm->mod << 1, NULL);
+
+    if(job.partitionCount <= job.dm->mod)
+    {
+        dtRun(threadCount, dmParallelBuildStitch, &job);
+    }
+    else
+    {
+        // Too few entries to keep partitions apart; not worth any threads anyway
+        job.threadCount = 1;
+        dmParallelBuildStitch(0, &job);
+    }
+
+    for(i = 0; i < job.partitionCount; ++i)
+    {
+        dmDestroy(job.partitions[i], NULL); // all entries were moved out
+    }
+    free(job.partitions);
+    free(job.hashes);
+    return job.dm;
+}
+
+void dmMerge(dynMap *dst, dynMap *src, void * /*dynMapMergeFunc*/ func, void *userData)
+{
+    dynMapMergeFunc mergeFunc = (dynMapMergeFunc)func;
+    dynSize copySize;
+    dynSize tableIndex;
+    if(!dst || !src || (dst == src))
+        return;
+    if((dst->flags & (DKF_STRING|DKF_INTEGER)) != (src->flags & (DKF_STRING|DKF_INTEGER)))
+        return;
+
+    copySize = (dst->elementSize < src->elementSize) ? dst->elementSize : src->elementSize;
+    for(tableIndex = 0; tableIndex < daSize(&src->table); ++tableIndex)
+    {
+        dynMapEntry *srcEntry = src->table[tableIndex];
+        for( ; srcEntry; srcEntry = srcEntry->next)
+        {
+            dynMapEntry *dstEntry;
+            dynSize prevCount = dst->count;
+            if(dst->flags & DKF_INTEGER)
+                dstEntry = dmFindIntegerHashed(dst, srcEntry->keyInt, srcEntry->hash, 1);
+            else
+                dstEntry = dmFindStringHashed(dst, srcEntry->keyStr, srcEntry->hash, 1);
+
+            if(mergeFunc && (dst->count == prevCount))
+                mergeFunc(dst, dstEntry, srcEntry, userData);
+            else
+                memcpy(dmEntryData(dstEntry), dmEntryData(srcEntry), copySize);
+        }
+    }
+}
+
 // ------------------------------------------------------------------------------------------------
 // Entry funcs
 
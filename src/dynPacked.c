@@ -0,0 +1,315 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "dyn.h"
+#include "dynSimd.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ------------------------------------------------------------------------------------------------
+// Constants and Macros
+
+// Values are packed DZ_BLOCK_SIZE at a time, every value in a block using the same bit width.
+// A block is stored "vertically" across 4 lanes: value i lives in lane (i % 4), slot (i / 4), and
+// each lane's 32 slots are packed into width consecutive words of that lane. Word w of lane l is
+// at index (w * 4) + l, so one 16 byte load pulls in the same word of all four lanes, and one
+// shift/mask produces four consecutive values. With DZF_DELTA the packed numbers are the
+// differences from the value four places earlier, so decoding them is one vector add per four
+// values instead of a serial running total.
+//
+// Encoded block: [width] followed by (width * 4) words of packed data.
+#define DZ_LANES 4
+#define DZ_SLOTS (DZ_BLOCK_SIZE / DZ_LANES)
+
+#define lowMask(WIDTH) (((WIDTH) >= 32) ? 0xffffffffU : ((1U << (WIDTH)) - 1))
+
+// ------------------------------------------------------------------------------------------------
+// Internal structures
+
+struct dynPackedArray
+{
+    dynU32 *blocks;          // dynArray of encoded blocks
+    dynU32 *tail;            // dynArray of the last (size % DZ_BLOCK_SIZE) values, not yet packed
+    dynU32 last[DZ_LANES];   // the final four values of the last packed block (DZF_DELTA)
+    dynSize size;
+    int flags;
+};
+
+// ------------------------------------------------------------------------------------------------
+// Internal helper functions
+
+static int bitWidth(dynU32 x)
+{
+    int width = 0;
+    while(x)
+    {
+        x >>= 1;
+        ++width;
+    }
+    return width;
+}
+
+// Packs the full tail into a new block at the end of pa->blocks
+static void dzPackTail(dynPackedArray *pa)
+{
+    dynU32 values[DZ_BLOCK_SIZE];
+    dynU32 *packed;
+    dynU32 bits = 0;
+    int width, i;
+
+    memcpy(values, pa->tail, sizeof(values));
+    if(pa->flags & DZF_DELTA)
+    {
+        for(i = DZ_BLOCK_SIZE - 1; i >= DZ_LANES; --i)
+            values[i] -= values[i - DZ_LANES];
+        for(i = 0; i < DZ_LANES; ++i)
+        {
+            values[i] -= pa->last[i];
+            pa->last[i] = pa->tail[DZ_BLOCK_SIZE - DZ_LANES + i];
+        }
+    }
+    for(i = 0; i < DZ_BLOCK_SIZE; ++i)
+        bits |= values[i];
+    width = bitWidth(bits);
+
+    daPushU32(&pa->blocks, (dynU32)width);
+    daClear(&pa->tail, NULL);
+    if(width == 0)
+        return; // a block of zeros is just its header
+
+    packed = (dynU32 *)daPushUninit(&pa->blocks, width * DZ_LANES);
+    memset(packed, 0, sizeof(dynU32) * width * DZ_LANES);
+    for(i = 0; i < DZ_BLOCK_SIZE; ++i)
+    {
+        int lane = i % DZ_LANES;
+        int offset = (i / DZ_LANES) * width;
+        int word = offset >> 5;
+        int shift = offset & 31;
+        packed[(word * DZ_LANES) + lane] |= values[i] << shift;
+        if((shift + width) > 32)
+            packed[((word + 1) * DZ_LANES) + lane] |= values[i] >> (32 - shift);
+    }
+}
+
+static void unpackScalar(const dynU32 *packed, int width, dynU32 *out)
+{
+    dynU32 mask = lowMask(width);
+    int slot, lane;
+    for(slot = 0; slot < DZ_SLOTS; ++slot)
+    {
+        int offset = slot * width;
+        int word = offset >> 5;
+        int shift = offset & 31;
+        for(lane = 0; lane < DZ_LANES; ++lane)
+        {
+            dynU32 v = packed[(word * DZ_LANES) + lane] >> shift;
+            if((shift + width) > 32)
+                v |= packed[((word + 1) * DZ_LANES) + lane] << (32 - shift);
+            out[(slot * DZ_LANES) + lane] = v & mask;
+        }
+    }
+}
+
+static void deltaScalar(dynU32 *values, dynU32 *last)
+{
+    int i;
+    for(i = 0; i < DZ_BLOCK_SIZE; ++i)
+    {
+        values[i] += last[i % DZ_LANES];
+        last[i % DZ_LANES] = values[i];
+    }
+}
+
+#if DYN_SIMD_X86
+
+// Every slot yields four consecutive values; the shift amounts vary by slot, so they go through
+// psrld/pslld's register forms. Delta decoding is folded into the same pass.
+DYN_TARGET("sse2") static void unpackSSE2(const dynU32 *packed, int width, dynU32 *out, dynU32 *last)
+{
+    __m128i mask = _mm_set1_epi32((int)lowMask(width));
+    __m128i running = last ? _mm_loadu_si128((const __m128i *)last) : _mm_setzero_si128();
+    int slot;
+    for(slot = 0; slot < DZ_SLOTS; ++slot)
+    {
+        int offset = slot * width;
+        int word = offset >> 5;
+        int shift = offset & 31;
+        __m128i v = _mm_srl_epi32(_mm_loadu_si128((const __m128i *)(packed + (word * DZ_LANES))), _mm_cvtsi32_si128(shift));
+        if((shift + width) > 32)
+        {
+            __m128i next = _mm_loadu_si128((const __m128i *)(packed + ((word + 1) * DZ_LANES)));
+            v = _mm_or_si128(v, _mm_sll_epi32(next, _mm_cvtsi32_si128(32 - shift)));
+        }
+        v = _mm_and_si128(v, mask);
+        if(last)
+        {
+            running = _mm_add_epi32(running, v);
+            v = running;
+        }
+        _mm_storeu_si128((__m128i *)(out + (slot * DZ_LANES)), v);
+    }
+    if(last)
+        _mm_storeu_si128((__m128i *)last, running);
+}
+
+#endif
+
+// Decodes one block into out (DZ_BLOCK_SIZE values); last carries the delta lanes from block to
+// block. Returns the number of words the block took up.
+static dynSize dzUnpack(const dynU32 *block, dynU32 *out, dynU32 *last)
+{
+    int width = (int)block[0];
+    if(width == 0)
+    {
+        memset(out, 0, sizeof(dynU32) * DZ_BLOCK_SIZE);
+        if(last)
+            deltaScalar(out, last);
+        return 1;
+    }
+#if DYN_SIMD_X86
+    if(dynSimdLevel() >= SIMD_SSE2)
+    {
+        unpackSSE2(block + 1, width, out, last);
+        return 1 + (width * DZ_LANES);
+    }
+#endif
+    unpackScalar(block + 1, width, out);
+    if(last)
+        deltaScalar(out, last);
+    return 1 + (width * DZ_LANES);
+}
+
+// ------------------------------------------------------------------------------------------------
+// creation / destruction / cleanup
+
+dynPackedArray *dzCreate(int flags)
+{
+    dynPackedArray *pa = (dynPackedArray *)calloc(1, sizeof(*pa));
+    pa->flags = flags;
+    daCreate(&pa->blocks, sizeof(dynU32));
+    daCreate(&pa->tail, sizeof(dynU32));
+    return pa;
+}
+
+void dzDestroy(dynPackedArray *pa)
+{
+    if(pa)
+    {
+        daDestroy(&pa->blocks, NULL);
+        daDestroy(&pa->tail, NULL);
+        free(pa);
+    }
+}
+
+void dzClear(dynPackedArray *pa)
+{
+    daClear(&pa->blocks, NULL);
+    daClear(&pa->tail, NULL);
+    memset(pa->last, 0, sizeof(pa->last));
+    pa->size = 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Growth
+
+void dzAppend(dynPackedArray *pa, dynU32 value)
+{
+    if(pa->size == dynSizeMax)
+        abort();
+    daPushU32(&pa->tail, value);
+    ++pa->size;
+    if(daSize(&pa->tail) == DZ_BLOCK_SIZE)
+        dzPackTail(pa);
+}
+
+void dzAppendN(dynPackedArray *pa, const dynU32 *values, dynSize count)
+{
+    if(count > (dynSizeMax - pa->size))
+        abort();
+    while(count > 0)
+    {
+        dynSize room = DZ_BLOCK_SIZE - daSize(&pa->tail);
+        if(room > count)
+            room = count;
+        memcpy(daPushUninit(&pa->tail, room), values, sizeof(dynU32) * room);
+        pa->size += room;
+        values += room;
+        count -= room;
+        if(daSize(&pa->tail) == DZ_BLOCK_SIZE)
+            dzPackTail(pa);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Access
+
+dynSize dzSize(dynPackedArray *pa)
+{
+    return pa->size;
+}
+
+dynSize dzBytes(dynPackedArray *pa)
+{
+    return (daSize(&pa->blocks) + daSize(&pa->tail)) * (dynSize)sizeof(dynU32);
+}
+
+void dzDecode(dynPackedArray *pa, void *daptr)
+{
+    dynU32 last[DZ_LANES] = { 0 };
+    dynU32 *out;
+    dynSize blockWords = daSize(&pa->blocks);
+    dynSize tailCount = daSize(&pa->tail);
+    dynSize word = 0;
+
+    if(*(char **)daptr && (dynValuesToArray((char **)daptr)->elementSize != sizeof(dynU32)))
+        daDestroy(daptr, NULL);
+    daCreate(daptr, sizeof(dynU32));
+    daClear(daptr, NULL);
+    if(pa->size == 0)
+        return;
+    out = (dynU32 *)daPushUninit(daptr, pa->size);
+    while(word < blockWords)
+    {
+        word += dzUnpack(pa->blocks + word, out, (pa->flags & DZF_DELTA) ? last : NULL);
+        out += DZ_BLOCK_SIZE;
+    }
+    memcpy(out, pa->tail, sizeof(dynU32) * tailCount);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Iteration
+
+void dzIterBegin(dynPackedIter *iter, dynPackedArray *pa)
+{
+    memset(iter, 0, sizeof(*iter));
+    iter->pa = pa;
+}
+
+dynSize dzIterNextBlock(dynPackedIter *iter)
+{
+    dynPackedArray *pa = iter->pa;
+    iter->pos = 0;
+    iter->count = 0;
+    if(iter->word < daSize(&pa->blocks))
+    {
+        iter->word += dzUnpack(pa->blocks + iter->word, iter->values, (pa->flags & DZF_DELTA) ? iter->last : NULL);
+        iter->count = DZ_BLOCK_SIZE;
+    }
+    else if(!iter->tailDone)
+    {
+        iter->count = daSize(&pa->tail);
+        memcpy(iter->values, pa->tail, sizeof(dynU32) * iter->count);
+        iter->tailDone = 1;
+    }
+    return iter->count;
+}
+
+int (dzIterNext)(dynPackedIter *iter, dynU32 *value)
+{
+    return dzIterNextInline(iter, value);
+}
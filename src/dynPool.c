@@ -0,0 +1,189 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "dyn.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// ------------------------------------------------------------------------------------------------
+// Constants and Macros
+
+#define DEFAULT_BLOCK_BYTES (64 * 1024) // dpCreate(..., 0) aims for blocks about this big
+#define MIN_BLOCK_OBJECTS   16
+
+// ------------------------------------------------------------------------------------------------
+// Internal structures
+
+// Free objects are threaded into a list through their own first bytes
+typedef struct dynPoolFree
+{
+    struct dynPoolFree *next;
+} dynPoolFree;
+
+struct dynPool
+{
+    char **blocks;         // dynArray of blocks, each holding objectsPerBlock objects
+    dynPoolFree *freeList; // objects handed back by dpFree()
+    char *bump;            // next never-used object in the newest block
+    char *bumpEnd;
+    dynSize objectSize;    // requested size
+    dynSize slotSize;      // requested size, padded for alignment and the free list link
+    dynSize objectsPerBlock;
+    dynSize liveCount;
+};
+
+// ------------------------------------------------------------------------------------------------
+// Internal helper functions
+
+// Adds a block; its objects are handed out lazily by bumping, so it isn't touched up front
+static void dpGrow(dynPool *pool)
+{
+    unsigned long long bytes = (unsigned long long)pool->slotSize * (unsigned long long)pool->objectsPerBlock;
+    char *block;
+    if(bytes > (unsigned long long)SIZE_MAX)
+        abort();
+    block = (char *)malloc((size_t)bytes);
+    if(!block)
+        abort();
+    daPush(&pool->blocks, block);
+    pool->bump = block;
+    pool->bumpEnd = block + bytes;
+}
+
+// ------------------------------------------------------------------------------------------------
+// creation / destruction / cleanup
+
+dynPool *dpCreate(dynSize objectSize, dynSize objectsPerBlock)
+{
+    dynPool *pool = (dynPool *)calloc(1, sizeof(*pool));
+    dynSize align;
+    if(objectSize <= 0)
+        objectSize = 1;
+    align = (objectSize >= 16) ? 16 : 8;
+
+    pool->objectSize = objectSize;
+    pool->slotSize = (objectSize < (dynSize)sizeof(dynPoolFree)) ? (dynSize)sizeof(dynPoolFree) : objectSize;
+    pool->slotSize = (pool->slotSize + (align - 1)) & ~(align - 1);
+    if(objectsPerBlock <= 0)
+        objectsPerBlock = DEFAULT_BLOCK_BYTES / pool->slotSize;
+    if(objectsPerBlock < MIN_BLOCK_OBJECTS)
+        objectsPerBlock = MIN_BLOCK_OBJECTS;
+    pool->objectsPerBlock = objectsPerBlock;
+    daCreate(&pool->blocks, sizeof(char *));
+    return pool;
+}
+
+void dpDestroy(dynPool *pool)
+{
+    if(pool)
+    {
+        daDestroy(&pool->blocks, free);
+        free(pool);
+    }
+}
+
+void dpClear(dynPool *pool)
+{
+    // Keep one block around to start over in; the rest go back to the system
+    char *first = daSize(&pool->blocks) ? pool->blocks[0] : NULL;
+    dynSize i;
+    for(i = 1; i < daSize(&pool->blocks); ++i)
+        free(pool->blocks[i]);
+    daSetSize(&pool->blocks, first ? 1 : 0, NULL);
+    pool->freeList = NULL;
+    pool->bump = first;
+    pool->bumpEnd = first ? (first + (pool->slotSize * pool->objectsPerBlock)) : NULL;
+    pool->liveCount = 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Allocation
+
+void *dpAlloc(dynPool *pool)
+{
+    void *p;
+    if(pool->freeList)
+    {
+        p = pool->freeList;
+        pool->freeList = pool->freeList->next;
+    }
+    else
+    {
+        if(pool->bump == pool->bumpEnd)
+            dpGrow(pool);
+        p = pool->bump;
+        pool->bump += pool->slotSize;
+    }
+    ++pool->liveCount;
+    return p;
+}
+
+void *dpCalloc(dynPool *pool)
+{
+    void *p = dpAlloc(pool);
+    memset(p, 0, pool->objectSize);
+    return p;
+}
+
+void dpFree(dynPool *pool, void *p)
+{
+    dynPoolFree *node = (dynPoolFree *)p;
+    if(!p)
+        return;
+    node->next = pool->freeList;
+    pool->freeList = node;
+    --pool->liveCount;
+}
+
+void dpAllocN(dynPool *pool, void **objects, dynSize count)
+{
+    dynSize i = 0;
+    while(i < count)
+    {
+        if(pool->freeList)
+        {
+            objects[i++] = pool->freeList;
+            pool->freeList = pool->freeList->next;
+        }
+        else
+        {
+            // Carve as many as fit out of the current block in one go
+            dynSize available;
+            if(pool->bump == pool->bumpEnd)
+                dpGrow(pool);
+            available = (dynSize)((pool->bumpEnd - pool->bump) / pool->slotSize);
+            for( ; (available > 0) && (i < count); --available)
+            {
+                objects[i++] = pool->bump;
+                pool->bump += pool->slotSize;
+            }
+        }
+    }
+    pool->liveCount += count;
+}
+
+void dpFreeN(dynPool *pool, void **objects, dynSize count)
+{
+    dynSize i;
+    for(i = 0; i < count; ++i)
+    {
+        dynPoolFree *node = (dynPoolFree *)objects[i];
+        if(node)
+        {
+            node->next = pool->freeList;
+            pool->freeList = node;
+            --pool->liveCount;
+        }
+    }
+}
+
+dynSize dpLiveCount(dynPool *pool)
+{
+    return pool->liveCount;
+}
@@ -0,0 +1,264 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "dyn.h"
+#include "dynAtomic.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ------------------------------------------------------------------------------------------------
+// Constants and Macros
+
+#define CACHE_LINE 64
+#define MIN_QUEUE_CAPACITY 2
+
+#define slotAt(DQ, POS) ((DQ)->values + (((POS) & (DQ)->mask) * (DQ)->elementSize))
+
+// ------------------------------------------------------------------------------------------------
+// Internal structures
+
+// The producer's and consumer's counters live on their own cache lines so the two sides don't
+// keep stealing a line from each other. Positions only ever increase; a slot is (pos & mask).
+struct dynQueue
+{
+    char *values;            // dynArray of capacity elements
+    dynAtomic64 *sequences;  // dynArray of per-slot sequence numbers (DQF_MPMC only)
+    dynSize elementSize;
+    long long mask;          // capacity - 1
+    int flags;
+    char pad0[CACHE_LINE];
+
+    dynAtomic64 tail;        // next position to write
+    long long cachedHead;    // SPSC producer's last look at head
+    char pad1[CACHE_LINE - (2 * sizeof(long long))];
+
+    dynAtomic64 head;        // next position to read
+    long long cachedTail;    // SPSC consumer's last look at tail
+    char pad2[CACHE_LINE - (2 * sizeof(long long))];
+};
+
+// ------------------------------------------------------------------------------------------------
+// Internal helper functions
+
+// Copies count elements between src and the ring starting at position pos, wrapping as needed
+static void dqCopyIn(dynQueue *dq, long long pos, const char *src, dynSize count)
+{
+    dynSize capacity = (dynSize)(dq->mask + 1);
+    dynSize first = capacity - (dynSize)(pos & dq->mask);
+    if(first > count)
+        first = count;
+    memcpy(slotAt(dq, pos), src, (size_t)first * dq->elementSize);
+    memcpy(dq->values, src + (first * dq->elementSize), (size_t)(count - first) * dq->elementSize);
+}
+
+static void dqCopyOut(dynQueue *dq, long long pos, char *dst, dynSize count)
+{
+    dynSize capacity = (dynSize)(dq->mask + 1);
+    dynSize first = capacity - (dynSize)(pos & dq->mask);
+    if(first > count)
+        first = count;
+    memcpy(dst, slotAt(dq, pos), (size_t)first * dq->elementSize);
+    memcpy(dst + (first * dq->elementSize), dq->values, (size_t)(count - first) * dq->elementSize);
+}
+
+// Single producer / single consumer: each side owns one counter and only reads the other's
+
+static dynSize dqPushSPSC(dynQueue *dq, const char *src, dynSize count)
+{
+    long long tail = dynAtomicLoad64(&dq->tail); // only this thread writes it
+    long long capacity = dq->mask + 1;
+    long long room = capacity - (tail - dq->cachedHead);
+    if(room < count)
+    {
+        dq->cachedHead = dynAtomicLoadAcquire64(&dq->head);
+        room = capacity - (tail - dq->cachedHead);
+    }
+    if(count > room)
+        count = (dynSize)room;
+    if(count > 0)
+    {
+        dqCopyIn(dq, tail, src, count);
+        dynAtomicStoreRelease64(&dq->tail, tail + count);
+    }
+    return count;
+}
+
+static dynSize dqPopSPSC(dynQueue *dq, char *dst, dynSize count)
+{
+    long long head = dynAtomicLoad64(&dq->head); // only this thread writes it
+    long long available = dq->cachedTail - head;
+    if(available < count)
+    {
+        dq->cachedTail = dynAtomicLoadAcquire64(&dq->tail);
+        available = dq->cachedTail - head;
+    }
+    if(count > available)
+        count = (dynSize)available;
+    if(count > 0)
+    {
+        dqCopyOut(dq, head, dst, count);
+        dynAtomicStoreRelease64(&dq->head, head + count);
+    }
+    return count;
+}
+
+// Multiple producers / consumers (Vyukov's bounded queue): slot i is free for position p when its
+// sequence is p, and holds position p's element when its sequence is p + 1. A batch claims as
+// long a run of ready slots as it can with a single CAS on the shared counter.
+
+static dynSize dqPushMPMC(dynQueue *dq, const char *src, dynSize count)
+{
+    long long pos;
+    dynSize claimed, i;
+    for(;;)
+    {
+        pos = dynAtomicLoad64(&dq->tail);
+        for(claimed = 0; claimed < count; ++claimed)
+        {
+            long long sequence = dynAtomicLoadAcquire64(&dq->sequences[(pos + claimed) & dq->mask]);
+            if(sequence != (pos + claimed))
+                break;
+        }
+        if(claimed == 0)
+        {
+            long long sequence = dynAtomicLoadAcquire64(&dq->sequences[pos & dq->mask]);
+            if(sequence < pos)
+                return 0; // full
+            continue;     // someone else claimed pos; look again
+        }
+        if(dynAtomicCAS64(&dq->tail, pos, pos + claimed))
+            break;
+    }
+
+    for(i = 0; i < claimed; ++i)
+    {
+        memcpy(slotAt(dq, pos + i), src + (i * dq->elementSize), dq->elementSize);
+        dynAtomicStoreRelease64(&dq->sequences[(pos + i) & dq->mask], pos + i + 1);
+    }
+    return claimed;
+}
+
+static dynSize dqPopMPMC(dynQueue *dq, char *dst, dynSize count)
+{
+    long long pos;
+    dynSize claimed, i;
+    for(;;)
+    {
+        pos = dynAtomicLoad64(&dq->head);
+        for(claimed = 0; claimed < count; ++claimed)
+        {
+            long long sequence = dynAtomicLoadAcquire64(&dq->sequences[(pos + claimed) & dq->mask]);
+            if(sequence != (pos + claimed + 1))
+                break;
+        }
+        if(claimed == 0)
+        {
+            long long sequence = dynAtomicLoadAcquire64(&dq->sequences[pos & dq->mask]);
+            if(sequence < (pos + 1))
+                return 0; // empty
+            continue;     // someone else took pos; look again
+        }
+        if(dynAtomicCAS64(&dq->head, pos, pos + claimed))
+            break;
+    }
+
+    for(i = 0; i < claimed; ++i)
+    {
+        memcpy(dst + (i * dq->elementSize), slotAt(dq, pos + i), dq->elementSize);
+        dynAtomicStoreRelease64(&dq->sequences[(pos + i) & dq->mask], pos + i + dq->mask + 1);
+    }
+    return claimed;
+}
+
+// ------------------------------------------------------------------------------------------------
+// creation / destruction
+
+dynQueue *dqCreate(dynSize elementSize, dynSize capacity, int flags)
+{
+    dynQueue *dq = (dynQueue *)calloc(1, sizeof(*dq));
+    dynSize roundedCapacity = MIN_QUEUE_CAPACITY;
+    dynSize i;
+    if(elementSize <= 0)
+        elementSize = sizeof(char*);
+    while(roundedCapacity < capacity)
+    {
+        if(roundedCapacity > (dynSizeMax / 2))
+            abort();
+        roundedCapacity *= 2;
+    }
+
+    dq->elementSize = elementSize;
+    dq->mask = roundedCapacity - 1;
+    dq->flags = flags;
+    daCreate(&dq->values, elementSize);
+    daReserveUninit(&dq->values, roundedCapacity);
+    if(flags & DQF_MPMC)
+    {
+        daCreate(&dq->sequences, sizeof(dynAtomic64));
+        daReserveUninit(&dq->sequences, roundedCapacity);
+        for(i = 0; i < roundedCapacity; ++i)
+            dynAtomicStore64(&dq->sequences[i], i);
+    }
+    return dq;
+}
+
+void dqDestroy(dynQueue *dq)
+{
+    if(dq)
+    {
+        daDestroy(&dq->sequences, NULL);
+        daDestroy(&dq->values, NULL);
+        free(dq);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Queue operations
+
+int dqPush(dynQueue *dq, const void *element)
+{
+    return (int)dqPushN(dq, element, 1);
+}
+
+int dqPop(dynQueue *dq, void *out)
+{
+    return (int)dqPopN(dq, out, 1);
+}
+
+dynSize dqPushN(dynQueue *dq, const void *src, dynSize count)
+{
+    if(count <= 0)
+        return 0;
+    if(dq->flags & DQF_MPMC)
+        return dqPushMPMC(dq, (const char *)src, count);
+    return dqPushSPSC(dq, (const char *)src, count);
+}
+
+dynSize dqPopN(dynQueue *dq, void *dst, dynSize maxCount)
+{
+    if(maxCount <= 0)
+        return 0;
+    if(dq->flags & DQF_MPMC)
+        return dqPopMPMC(dq, (char *)dst, maxCount);
+    return dqPopSPSC(dq, (char *)dst, maxCount);
+}
+
+dynSize dqSize(dynQueue *dq)
+{
+    long long size = dynAtomicLoad64(&dq->tail) - dynAtomicLoad64(&dq->head);
+    if(size < 0)
+        size = 0;
+    if(size > (dq->mask + 1))
+        size = dq->mask + 1;
+    return (dynSize)size;
+}
+
+dynSize dqCapacity(dynQueue *dq)
+{
+    return (dynSize)(dq->mask + 1);
+}
@@ -0,0 +1,126 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "dyn.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ------------------------------------------------------------------------------------------------
+// creation / destruction / cleanup
+
+dynRecords *drCreate(const dynRecordField *fields, int fieldCount, dynSize recordSize)
+{
+    dynRecords *dr = (dynRecords *)calloc(1, sizeof(*dr));
+    int i;
+    dr->fieldCount = fieldCount;
+    dr->recordSize = recordSize;
+    dr->fields = (dynRecordField *)malloc(fieldCount * sizeof(dynRecordField));
+    dr->columns = (char **)calloc(fieldCount, sizeof(char *));
+    memcpy(dr->fields, fields, fieldCount * sizeof(dynRecordField));
+    for(i = 0; i < fieldCount; ++i)
+        daCreate(&dr->columns[i], fields[i].size);
+    return dr;
+}
+
+void drDestroy(dynRecords *dr)
+{
+    if(dr)
+    {
+        int i;
+        for(i = 0; i < dr->fieldCount; ++i)
+            daDestroy(&dr->columns[i], NULL);
+        free(dr->columns);
+        free(dr->fields);
+        free(dr);
+    }
+}
+
+void drClear(dynRecords *dr)
+{
+    int i;
+    for(i = 0; i < dr->fieldCount; ++i)
+        daClear(&dr->columns[i], NULL);
+    dr->size = 0;
+}
+
+void drReserve(dynRecords *dr, dynSize capacity)
+{
+    int i;
+    if(capacity <= dr->size)
+        return;
+    for(i = 0; i < dr->fieldCount; ++i)
+        daSetCapacity(&dr->columns[i], capacity, NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Record access
+
+dynSize drPush(dynRecords *dr, const void *record)
+{
+    int i;
+    for(i = 0; i < dr->fieldCount; ++i)
+    {
+        char *dst = (char *)daPushUninit(&dr->columns[i], 1);
+        if(record)
+            memcpy(dst, (const char *)record + dr->fields[i].offset, dr->fields[i].size);
+        else
+            memset(dst, 0, dr->fields[i].size);
+    }
+    return dr->size++;
+}
+
+int drGet(dynRecords *dr, dynSize index, void *record)
+{
+    int i;
+    if((index < 0) || (index >= dr->size))
+        return 0;
+    for(i = 0; i < dr->fieldCount; ++i)
+        memcpy((char *)record + dr->fields[i].offset, dr->columns[i] + (index * dr->fields[i].size), dr->fields[i].size);
+    return 1;
+}
+
+void drSet(dynRecords *dr, dynSize index, const void *record)
+{
+    int i;
+    if((index < 0) || (index >= dr->size))
+        return;
+    for(i = 0; i < dr->fieldCount; ++i)
+        memcpy(dr->columns[i] + (index * dr->fields[i].size), (const char *)record + dr->fields[i].offset, dr->fields[i].size);
+}
+
+void drErase(dynRecords *dr, dynSize index)
+{
+    int i;
+    if((index < 0) || (index >= dr->size))
+        return;
+    for(i = 0; i < dr->fieldCount; ++i)
+        daErase(&dr->columns[i], index);
+    --dr->size;
+}
+
+dynSize drSize(dynRecords *dr)
+{
+    return dr->size;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Column access
+
+void *drColumn(dynRecords *dr, int fieldIndex)
+{
+    if((fieldIndex < 0) || (fieldIndex >= dr->fieldCount) || (dr->size == 0))
+        return NULL;
+    return dr->columns[fieldIndex];
+}
+
+void *drColumnArray(dynRecords *dr, int fieldIndex)
+{
+    if((fieldIndex < 0) || (fieldIndex >= dr->fieldCount))
+        return NULL;
+    return &dr->columns[fieldIndex];
+}
@@ -0,0 +1,588 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "dyn.h"
+#include "dynAtomic.h"
+#include "dynSimd.h"
+#include "dynSlots.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ------------------------------------------------------------------------------------------------
+// Internal helper functions
+
+static dynAtomic64 cachedSimdLevel = -1;
+
+static int simdDetect(void)
+{
+    int level = SIMD_SCALAR;
+#if DYN_SIMD_X86
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    if(info[3] & (1 << 26))
+        level = SIMD_SSE2;
+    if((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6))
+    {
+        __cpuidex(info, 7, 0);
+        if(info[1] & (1 << 5))
+            level = SIMD_AVX2;
+    }
+#else
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse2"))
+        level = SIMD_SSE2;
+    if(__builtin_cpu_supports("avx2"))
+        level = SIMD_AVX2;
+#endif
+#endif
+    return level;
+}
+
+int dynSimdLevel(void)
+{
+    long long level = dynAtomicLoad64(&cachedSimdLevel);
+    if(level < 0)
+    {
+        const char *levelEnv = getenv("DYN_SIMD_LEVEL");
+        level = simdDetect();
+        if(levelEnv && (atoi(levelEnv) < level))
+            level = atoi(levelEnv);
+        if(level < 0)
+            level = SIMD_SCALAR;
+        dynAtomicStore64(&cachedSimdLevel, level); // every thread computes the same answer
+    }
+    return (int)level;
+}
+
+// Writing kernels: returns the array's size if it holds elements of exactly elementSize (and
+// unshares and linearizes it), otherwise 0
+static dynSize simdPrepare(void *daptr, dynSize elementSize)
+{
+    dynArray *da;
+    if(!daptr || !*(char **)daptr)
+        return 0;
+    da = dynValuesToArray((char **)daptr);
+    if(da->elementSize != elementSize)
+        return 0;
+    daUnshare(daptr);
+    daLinearize(daptr);
+    return dynValuesToArray((char **)daptr)->size;
+}
+
+// Read-only kernels: describes the elements as contiguous runs, returning how many there are (0 if
+// the array is missing, empty or the wrong element size). A wrapped deque is two runs; it isn't
+// linearized, as other threads (or daClone() snapshots) may be reading it at the same time.
+static int simdRuns(void *daptr, dynSize elementSize, char **runs, dynSize *counts)
+{
+    dynArray *da;
+    if(!daptr || !*(char **)daptr)
+        return 0;
+    da = dynValuesToArray((char **)daptr);
+    if(da->elementSize != elementSize)
+        return 0;
+    return daRuns(da, 0, da->size, runs, counts);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Scalar kernels (also used for the tails the vector loops leave behind)
+
+static dynF32 sumF32Scalar(const dynF32 *v, dynSize start, dynSize count)
+{
+    dynF32 total = 0.0f;
+    dynSize i;
+    for(i = start; i < count; ++i)
+        total += v[i];
+    return total;
+}
+
+static dynU64 sumU32Scalar(const dynU32 *v, dynSize start, dynSize count)
+{
+    dynU64 total = 0;
+    dynSize i;
+    for(i = start; i < count; ++i)
+        total += v[i];
+    return total;
+}
+
+static dynF32 dotF32Scalar(const dynF32 *a, const dynF32 *b, dynSize start, dynSize count)
+{
+    dynF32 total = 0.0f;
+    dynSize i;
+    for(i = start; i < count; ++i)
+        total += a[i] * b[i];
+    return total;
+}
+
+static void minMaxU32Scalar(const dynU32 *v, dynSize start, dynSize count, dynU32 *minValue, dynU32 *maxValue)
+{
+    dynSize i;
+    for(i = start; i < count; ++i)
+    {
+        if(v[i] < *minValue)
+            *minValue = v[i];
+        if(v[i] > *maxValue)
+            *maxValue = v[i];
+    }
+}
+
+static void minMaxF32Scalar(const dynF32 *v, dynSize start, dynSize count, dynF32 *minValue, dynF32 *maxValue)
+{
+    dynSize i;
+    for(i = start; i < count; ++i)
+    {
+        if(v[i] < *minValue)
+            *minValue = v[i];
+        if(v[i] > *maxValue)
+            *maxValue = v[i];
+    }
+}
+
+static void scaleF32Scalar(dynF32 *v, dynSize start, dynSize count, dynF32 scale)
+{
+    dynSize i;
+    for(i = start; i < count; ++i)
+        v[i] *= scale;
+}
+
+static void prefixSumU32Scalar(dynU32 *v, dynSize start, dynSize count, dynU32 running)
+{
+    dynSize i;
+    for(i = start; i < count; ++i)
+    {
+        running += v[i];
+        v[i] = running;
+    }
+}
+
+#if DYN_SIMD_X86
+
+// ------------------------------------------------------------------------------------------------
+// SSE2 kernels
+
+DYN_TARGET("sse2") static dynF32 sumF32SSE2(const dynF32 *v, dynSize count)
+{
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    dynF32 lanes[4];
+    dynSize i;
+    for(i = 0; (i + 8) <= count; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_loadu_ps(v + i));
+        acc1 = _mm_add_ps(acc1, _mm_loadu_ps(v + i + 4));
+    }
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sumF32Scalar(v, i, count);
+}
+
+DYN_TARGET("sse2") static dynU64 sumU32SSE2(const dynU32 *v, dynSize count)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    dynU64 lanes[2];
+    dynSize i;
+    for(i = 0; (i + 4) <= count; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(v + i));
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(x, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(x, zero));
+    }
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    return lanes[0] + lanes[1] + sumU32Scalar(v, i, count);
+}
+
+DYN_TARGET("sse2") static dynF32 dotF32SSE2(const dynF32 *a, const dynF32 *b, dynSize count)
+{
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    dynF32 lanes[4];
+    dynSize i;
+    for(i = 0; (i + 8) <= count; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + dotF32Scalar(a, b, i, count);
+}
+
+// SSE2 only has signed 32 bit compares, so the values are biased by 2^31 on the way in and out
+DYN_TARGET("sse2") static void minMaxU32SSE2(const dynU32 *v, dynSize count, dynU32 *minValue, dynU32 *maxValue)
+{
+    __m128i bias = _mm_set1_epi32((int)0x80000000);
+    __m128i lo = _mm_xor_si128(_mm_set1_epi32((int)v[0]), bias);
+    __m128i hi = lo;
+    dynU32 lanes[8];
+    dynSize i;
+    for(i = 0; (i + 4) <= count; i += 4)
+    {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(v + i)), bias);
+        __m128i less = _mm_cmplt_epi32(x, lo);
+        __m128i greater = _mm_cmpgt_epi32(x, hi);
+        lo = _mm_or_si128(_mm_and_si128(less, x), _mm_andnot_si128(less, lo));
+        hi = _mm_or_si128(_mm_and_si128(greater, x), _mm_andnot_si128(greater, hi));
+    }
+    _mm_storeu_si128((__m128i *)lanes, _mm_xor_si128(lo, bias));
+    _mm_storeu_si128((__m128i *)(lanes + 4), _mm_xor_si128(hi, bias));
+    *minValue = *maxValue = v[0];
+    minMaxU32Scalar(lanes, 0, 8, minValue, maxValue);
+    minMaxU32Scalar(v, i, count, minValue, maxValue);
+}
+
+DYN_TARGET("sse2") static void minMaxF32SSE2(const dynF32 *v, dynSize count, dynF32 *minValue, dynF32 *maxValue)
+{
+    __m128 lo = _mm_set1_ps(v[0]);
+    __m128 hi = lo;
+    dynF32 lanes[8];
+    dynSize i;
+    for(i = 0; (i + 4) <= count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(v + i);
+        lo = _mm_min_ps(lo, x);
+        hi = _mm_max_ps(hi, x);
+    }
+    _mm_storeu_ps(lanes, lo);
+    _mm_storeu_ps(lanes + 4, hi);
+    *minValue = *maxValue = v[0];
+    minMaxF32Scalar(lanes, 0, 8, minValue, maxValue);
+    minMaxF32Scalar(v, i, count, minValue, maxValue);
+}
+
+DYN_TARGET("sse2") static void scaleF32SSE2(dynF32 *v, dynSize count, dynF32 scale)
+{
+    __m128 s = _mm_set1_ps(scale);
+    dynSize i;
+    for(i = 0; (i + 4) <= count; i += 4)
+        _mm_storeu_ps(v + i, _mm_mul_ps(_mm_loadu_ps(v + i), s));
+    scaleF32Scalar(v, i, count, scale);
+}
+
+// In-register scan of four lanes (two shifted adds), plus the carry from the previous block
+DYN_TARGET("sse2") static void prefixSumU32SSE2(dynU32 *v, dynSize count)
+{
+    __m128i carry = _mm_setzero_si128();
+    dynSize i;
+    for(i = 0; (i + 4) <= count; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(v + i));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, carry);
+        _mm_storeu_si128((__m128i *)(v + i), x);
+        carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    prefixSumU32Scalar(v, i, count, (i > 0) ? v[i - 1] : 0);
+}
+
+// ------------------------------------------------------------------------------------------------
+// AVX2 kernels
+
+DYN_TARGET("avx2") static dynF32 sumF32AVX2(const dynF32 *v, dynSize count)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    dynF32 lanes[8];
+    dynSize i;
+    for(i = 0; (i + 16) <= count; i += 16)
+    {
+        acc0 = _mm256_add_ps(acc0, _mm256_loadu_ps(v + i));
+        acc1 = _mm256_add_ps(acc1, _mm256_loadu_ps(v + i + 8));
+    }
+    _mm256_storeu_ps(lanes, _mm256_add_ps(acc0, acc1));
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])) + sumF32Scalar(v, i, count);
+}
+
+DYN_TARGET("avx2") static dynU64 sumU32AVX2(const dynU32 *v, dynSize count)
+{
+    __m256i acc = _mm256_setzero_si256();
+    dynU64 lanes[4];
+    dynSize i;
+    for(i = 0; (i + 8) <= count; i += 8)
+    {
+        acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)(v + i))));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)(v + i + 4))));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumU32Scalar(v, i, count);
+}
+
+DYN_TARGET("avx2") static dynF32 dotF32AVX2(const dynF32 *a, const dynF32 *b, dynSize count)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    dynF32 lanes[8];
+    dynSize i;
+    for(i = 0; (i + 16) <= count; i += 16)
+    {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    _mm256_storeu_ps(lanes, _mm256_add_ps(acc0, acc1));
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])) + dotF32Scalar(a, b, i, count);
+}
+
+DYN_TARGET("avx2") static void minMaxU32AVX2(const dynU32 *v, dynSize count, dynU32 *minValue, dynU32 *maxValue)
+{
+    __m256i lo = _mm256_set1_epi32((int)v[0]);
+    __m256i hi = lo;
+    dynU32 lanes[16];
+    dynSize i;
+    for(i = 0; (i + 8) <= count; i += 8)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(v + i));
+        lo = _mm256_min_epu32(lo, x);
+        hi = _mm256_max_epu32(hi, x);
+    }
+    _mm256_storeu_si256((__m256i *)lanes, lo);
+    _mm256_storeu_si256((__m256i *)(lanes + 8), hi);
+    *minValue = *maxValue = v[0];
+    minMaxU32Scalar(lanes, 0, 16, minValue, maxValue);
+    minMaxU32Scalar(v, i, count, minValue, maxValue);
+}
+
+DYN_TARGET("avx2") static void minMaxF32AVX2(const dynF32 *v, dynSize count, dynF32 *minValue, dynF32 *maxValue)
+{
+    __m256 lo = _mm256_set1_ps(v[0]);
+    __m256 hi = lo;
+    dynF32 lanes[16];
+    dynSize i;
+    for(i = 0; (i + 8) <= count; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(v + i);
+        lo = _mm256_min_ps(lo, x);
+        hi = _mm256_max_ps(hi, x);
+    }
+    _mm256_storeu_ps(lanes, lo);
+    _mm256_storeu_ps(lanes + 8, hi);
+    *minValue = *maxValue = v[0];
+    minMaxF32Scalar(lanes, 0, 16, minValue, maxValue);
+    minMaxF32Scalar(v, i, count, minValue, maxValue);
+}
+
+DYN_TARGET("avx2") static void scaleF32AVX2(dynF32 *v, dynSize count, dynF32 scale)
+{
+    __m256 s = _mm256_set1_ps(scale);
+    dynSize i;
+    for(i = 0; (i + 8) <= count; i += 8)
+        _mm256_storeu_ps(v + i, _mm256_mul_ps(_mm256_loadu_ps(v + i), s));
+    scaleF32Scalar(v, i, count, scale);
+}
+
+#endif // DYN_SIMD_X86
+
+// ------------------------------------------------------------------------------------------------
+// Numeric kernels
+
+static dynF32 sumF32Run(const dynF32 *v, dynSize count)
+{
+    switch(dynSimdLevel())
+    {
+#if DYN_SIMD_X86
+        case SIMD_AVX2: return sumF32AVX2(v, count);
+        case SIMD_SSE2: return sumF32SSE2(v, count);
+#endif
+        default: return sumF32Scalar(v, 0, count);
+    }
+}
+
+static dynU64 sumU32Run(const dynU32 *v, dynSize count)
+{
+    switch(dynSimdLevel())
+    {
+#if DYN_SIMD_X86
+        case SIMD_AVX2: return sumU32AVX2(v, count);
+        case SIMD_SSE2: return sumU32SSE2(v, count);
+#endif
+        default: return sumU32Scalar(v, 0, count);
+    }
+}
+
+static dynF32 dotF32Run(const dynF32 *a, const dynF32 *b, dynSize count)
+{
+    switch(dynSimdLevel())
+    {
+#if DYN_SIMD_X86
+        case SIMD_AVX2: return dotF32AVX2(a, b, count);
+        case SIMD_SSE2: return dotF32SSE2(a, b, count);
+#endif
+        default: return dotF32Scalar(a, b, 0, count);
+    }
+}
+
+static void minMaxU32Run(const dynU32 *v, dynSize count, dynU32 *lo, dynU32 *hi)
+{
+    switch(dynSimdLevel())
+    {
+#if DYN_SIMD_X86
+        case SIMD_AVX2: minMaxU32AVX2(v, count, lo, hi); break;
+        case SIMD_SSE2: minMaxU32SSE2(v, count, lo, hi); break;
+#endif
+        default:
+            *lo = *hi = v[0];
+            minMaxU32Scalar(v, 1, count, lo, hi);
+            break;
+    }
+}
+
+static void minMaxF32Run(const dynF32 *v, dynSize count, dynF32 *lo, dynF32 *hi)
+{
+    switch(dynSimdLevel())
+    {
+#if DYN_SIMD_X86
+        case SIMD_AVX2: minMaxF32AVX2(v, count, lo, hi); break;
+        case SIMD_SSE2: minMaxF32SSE2(v, count, lo, hi); break;
+#endif
+        default:
+            *lo = *hi = v[0];
+            minMaxF32Scalar(v, 1, count, lo, hi);
+            break;
+    }
+}
+
+dynF32 daSumF32(void *daptr)
+{
+    char *runs[2];
+    dynSize counts[2];
+    int runCount = simdRuns(daptr, sizeof(dynF32), runs, counts);
+    dynF32 total = 0.0f;
+    int i;
+    for(i = 0; i < runCount; ++i)
+        total += sumF32Run((const dynF32 *)runs[i], counts[i]);
+    return total;
+}
+
+dynU64 daSumU32(void *daptr)
+{
+    char *runs[2];
+    dynSize counts[2];
+    int runCount = simdRuns(daptr, sizeof(dynU32), runs, counts);
+    dynU64 total = 0;
+    int i;
+    for(i = 0; i < runCount; ++i)
+        total += sumU32Run((const dynU32 *)runs[i], counts[i]);
+    return total;
+}
+
+// Both arrays may be split in two, at different places, so this walks the (up to three) stretches
+// where neither side crosses a run boundary
+dynF32 daDotF32(void *daptr, void *otherptr)
+{
+    char *aRuns[2];
+    char *bRuns[2];
+    dynSize aCounts[2];
+    dynSize bCounts[2];
+    int aRunCount = simdRuns(daptr, sizeof(dynF32), aRuns, aCounts);
+    int bRunCount = simdRuns(otherptr, sizeof(dynF32), bRuns, bCounts);
+    int aRun = 0, bRun = 0;
+    dynSize aPos = 0, bPos = 0;
+    dynF32 total = 0.0f;
+    while((aRun < aRunCount) && (bRun < bRunCount))
+    {
+        dynSize count = aCounts[aRun] - aPos;
+        if(count > (bCounts[bRun] - bPos))
+            count = bCounts[bRun] - bPos;
+        total += dotF32Run((const dynF32 *)aRuns[aRun] + aPos, (const dynF32 *)bRuns[bRun] + bPos, count);
+        aPos += count;
+        bPos += count;
+        if(aPos == aCounts[aRun])
+        {
+            ++aRun;
+            aPos = 0;
+        }
+        if(bPos == bCounts[bRun])
+        {
+            ++bRun;
+            bPos = 0;
+        }
+    }
+    return total;
+}
+
+int daMinMaxU32(void *daptr, dynU32 *minValue, dynU32 *maxValue)
+{
+    char *runs[2];
+    dynSize counts[2];
+    int runCount = simdRuns(daptr, sizeof(dynU32), runs, counts);
+    dynU32 lo, hi, runLo, runHi;
+    int i;
+    if(runCount == 0)
+        return 0;
+    minMaxU32Run((const dynU32 *)runs[0], counts[0], &lo, &hi);
+    for(i = 1; i < runCount; ++i)
+    {
+        minMaxU32Run((const dynU32 *)runs[i], counts[i], &runLo, &runHi);
+        if(runLo < lo)
+            lo = runLo;
+        if(runHi > hi)
+            hi = runHi;
+    }
+    if(minValue)
+        *minValue = lo;
+    if(maxValue)
+        *maxValue = hi;
+    return 1;
+}
+
+int daMinMaxF32(void *daptr, dynF32 *minValue, dynF32 *maxValue)
+{
+    char *runs[2];
+    dynSize counts[2];
+    int runCount = simdRuns(daptr, sizeof(dynF32), runs, counts);
+    dynF32 lo, hi, runLo, runHi;
+    int i;
+    if(runCount == 0)
+        return 0;
+    minMaxF32Run((const dynF32 *)runs[0], counts[0], &lo, &hi);
+    for(i = 1; i < runCount; ++i)
+    {
+        minMaxF32Run((const dynF32 *)runs[i], counts[i], &runLo, &runHi);
+        if(runLo < lo)
+            lo = runLo;
+        if(runHi > hi)
+            hi = runHi;
+    }
+    if(minValue)
+        *minValue = lo;
+    if(maxValue)
+        *maxValue = hi;
+    return 1;
+}
+
+void daScaleF32(void *daptr, dynF32 scale)
+{
+    dynSize count = simdPrepare(daptr, sizeof(dynF32));
+    dynF32 *v;
+    if(count == 0)
+        return;
+    v = *(dynF32 **)daptr;
+    switch(dynSimdLevel())
+    {
+#if DYN_SIMD_X86
+        case SIMD_AVX2: scaleF32AVX2(v, count, scale); break;
+        case SIMD_SSE2: scaleF32SSE2(v, count, scale); break;
+#endif
+        default: scaleF32Scalar(v, 0, count, scale); break;
+    }
+}
+
+void daPrefixSumU32(void *daptr)
+{
+    dynSize count = simdPrepare(daptr, sizeof(dynU32));
+    dynU32 *v;
+    if(count == 0)
+        return;
+    v = *(dynU32 **)daptr;
+    switch(dynSimdLevel())
+    {
+#if DYN_SIMD_X86
+        case SIMD_AVX2: // the scan is bound by its serial carry; wider registers don't buy anything
+        case SIMD_SSE2: prefixSumU32SSE2(v, count); break;
+#endif
+        default: prefixSumU32Scalar(v, 0, count, 0); break;
+    }
+}
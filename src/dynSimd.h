@@ -0,0 +1,35 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#ifndef DYN_SIMD_H
+#define DYN_SIMD_H
+
+// Runtime SIMD dispatch shared by the modules with vector kernels. This is an internal header;
+// it is not installed alongside dyn.h.
+
+#include "dyn.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DYN_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define DYN_TARGET(ISA)                            // MSVC lets any function use any intrinsic
+#else
+#define DYN_TARGET(ISA) __attribute__((target(ISA)))
+#endif
+#endif
+
+#define SIMD_SCALAR 0
+#define SIMD_SSE2   1
+#define SIMD_AVX2   2
+
+// The best instruction set this CPU has, optionally capped by $DYN_SIMD_LEVEL (0 = scalar,
+// 1 = SSE2, 2 = AVX2) for benchmarking and testing the narrower paths.
+int dynSimdLevel(void);
+
+#endif
@@ -0,0 +1,201 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "dyn.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ------------------------------------------------------------------------------------------------
+// Constants and Macros
+
+#define NO_FREE_SLOT 0xffffffff
+
+#define makeHandle(SLOT, GENERATION) ((((dynHandle)(GENERATION)) << 32) | (dynHandle)(SLOT))
+#define handleSlot(HANDLE) ((dynU32)((HANDLE) & 0xffffffff))
+#define handleGeneration(HANDLE) ((dynU32)((HANDLE) >> 32))
+
+// ------------------------------------------------------------------------------------------------
+// Internal structures
+
+typedef struct dynSlot
+{
+    dynU32 dense;      // index into values while live, next free slot while free
+    dynU32 generation; // bumped on every erase, so old handles stop matching; never 0
+} dynSlot;
+
+// Live elements are packed densely in values (in no particular order); slots map a handle's
+// stable slot index to wherever its element currently lives, and denseSlots maps back.
+struct dynSlotMap
+{
+    char *values;       // dynArray of elementSize elements
+    dynU32 *denseSlots; // dynArray: slot index of each value
+    dynSlot *slots;     // dynArray
+    dynU32 freeHead;
+    dynSize elementSize;
+};
+
+// ------------------------------------------------------------------------------------------------
+// Internal helper functions
+
+// The slot a handle refers to, or NULL if the handle is stale or bogus
+static dynSlot *dhFindSlot(dynSlotMap *sm, dynHandle handle)
+{
+    dynU32 slotIndex = handleSlot(handle);
+    dynSlot *slot;
+    if(slotIndex >= (dynU32)daSize(&sm->slots))
+        return NULL;
+    slot = &sm->slots[slotIndex];
+    if((slot->generation != handleGeneration(handle)) || (slot->dense >= (dynU32)daSize(&sm->denseSlots)) || (sm->denseSlots[slot->dense] != slotIndex))
+        return NULL;
+    return slot;
+}
+
+// ------------------------------------------------------------------------------------------------
+// creation / destruction / cleanup
+
+dynSlotMap *dhCreate(dynSize elementSize)
+{
+    dynSlotMap *sm = (dynSlotMap *)calloc(1, sizeof(*sm));
+    if(elementSize <= 0)
+        elementSize = sizeof(char*);
+    sm->elementSize = elementSize;
+    sm->freeHead = NO_FREE_SLOT;
+    daCreate(&sm->values, elementSize);
+    daCreate(&sm->denseSlots, sizeof(dynU32));
+    daCreate(&sm->slots, sizeof(dynSlot));
+    return sm;
+}
+
+void dhDestroy(dynSlotMap *sm, void * /*dynDestroyFunc*/ destroyFunc)
+{
+    if(sm)
+    {
+        dhClear(sm, destroyFunc);
+        daDestroy(&sm->slots, NULL);
+        daDestroy(&sm->denseSlots, NULL);
+        daDestroy(&sm->values, NULL);
+        free(sm);
+    }
+}
+
+void dhClear(dynSlotMap *sm, void * /*dynDestroyFunc*/ destroyFunc)
+{
+    dynSize i;
+    daClearIndirect(&sm->values, destroyFunc);
+
+    // Every live slot becomes free (with a new generation), so all outstanding handles go stale
+    for(i = 0; i < daSize(&sm->denseSlots); ++i)
+    {
+        dynU32 slotIndex = sm->denseSlots[i];
+        dynSlot *slot = &sm->slots[slotIndex];
+        if(++slot->generation == 0)
+            slot->generation = 1;
+        slot->dense = sm->freeHead;
+        sm->freeHead = slotIndex;
+    }
+    daClear(&sm->denseSlots, NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Insertion / removal
+
+dynHandle dhInsert(dynSlotMap *sm, const void *value, void **element)
+{
+    dynU32 slotIndex;
+    dynSlot *slot;
+    dynSize dense = daSize(&sm->values);
+    char *dst;
+
+    if(sm->freeHead != NO_FREE_SLOT)
+    {
+        slotIndex = sm->freeHead;
+        slot = &sm->slots[slotIndex];
+        sm->freeHead = slot->dense;
+    }
+    else
+    {
+        dynSlot newSlot;
+        if((unsigned long long)daSize(&sm->slots) >= NO_FREE_SLOT)
+            abort(); // out of 32 bit slot indices
+        newSlot.dense = 0;
+        newSlot.generation = 1;
+        slotIndex = (dynU32)daPush(&sm->slots, newSlot);
+        slot = &sm->slots[slotIndex];
+    }
+
+    dst = (char *)daPushUninit(&sm->values, 1);
+    if(value)
+        memcpy(dst, value, sm->elementSize);
+    else
+        memset(dst, 0, sm->elementSize);
+    daPushU32(&sm->denseSlots, slotIndex);
+    slot->dense = (dynU32)dense;
+    if(element)
+        *element = dst;
+    return makeHandle(slotIndex, slot->generation);
+}
+
+int dhErase(dynSlotMap *sm, dynHandle handle, void * /*dynDestroyFunc*/ destroyFunc)
+{
+    dynSlot *slot = dhFindSlot(sm, handle);
+    dynU32 dense, last;
+    if(!slot)
+        return 0;
+
+    dense = slot->dense;
+    last = (dynU32)daSize(&sm->values) - 1;
+    if(destroyFunc)
+        ((dynDestroyFunc)destroyFunc)(sm->values + ((dynSize)dense * sm->elementSize));
+
+    // Fill the hole with the last element so the values stay packed
+    if(dense != last)
+    {
+        dynU32 movedSlot = sm->denseSlots[last];
+        memcpy(sm->values + ((dynSize)dense * sm->elementSize), sm->values + ((dynSize)last * sm->elementSize), sm->elementSize);
+        sm->denseSlots[dense] = movedSlot;
+        sm->slots[movedSlot].dense = dense;
+    }
+    daEraseRange(&sm->values, last, 1);
+    daEraseRange(&sm->denseSlots, last, 1);
+
+    if(++slot->generation == 0)
+        slot->generation = 1;
+    slot->dense = sm->freeHead;
+    sm->freeHead = handleSlot(handle);
+    return 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Access
+
+void *dhGet(dynSlotMap *sm, dynHandle handle)
+{
+    dynSlot *slot = dhFindSlot(sm, handle);
+    if(!slot)
+        return NULL;
+    return sm->values + ((dynSize)slot->dense * sm->elementSize);
+}
+
+dynSize dhSize(dynSlotMap *sm)
+{
+    return daSize(&sm->values);
+}
+
+void *dhValues(dynSlotMap *sm)
+{
+    return sm->values;
+}
+
+dynHandle dhHandleAt(dynSlotMap *sm, dynSize denseIndex)
+{
+    dynU32 slotIndex;
+    if((denseIndex < 0) || (denseIndex >= daSize(&sm->denseSlots)))
+        return DYN_INVALID_HANDLE;
+    slotIndex = sm->denseSlots[denseIndex];
+    return makeHandle(slotIndex, sm->slots[slotIndex].generation);
+}
@@ -0,0 +1,54 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#ifndef DYN_SLOTS_H
+#define DYN_SLOTS_H
+
+// Deque-aware element addressing for the modules that read dynArray storage directly. This is an
+// internal header; it is not installed alongside dyn.h.
+
+#include "dyn.h"
+
+// address of element [index], accounting for deque wraparound
+DYN_INLINE char *daSlot(dynArray *da, dynSize index)
+{
+    char *values = dynArrayToValues(da);
+    if(da->flags & DAF_DEQUE)
+    {
+        index += da->head;
+        if(index >= da->capacity)
+            index -= da->capacity;
+    }
+    return values + (index * da->elementSize);
+}
+
+// Splits elements [index, index + count) into the contiguous runs they occupy: two when a deque
+// wraps around the end of its storage, otherwise one (none for count <= 0). Nothing is moved, so
+// readers can use this on arrays other threads are reading too. Returns the number of runs.
+DYN_INLINE int daRuns(dynArray *da, dynSize index, dynSize count, char **runs, dynSize *counts)
+{
+    dynSize firstCount = count;
+    if(count <= 0)
+        return 0;
+    if(da->flags & DAF_DEQUE)
+    {
+        dynSize physical = da->head + index;
+        if(physical >= da->capacity)
+            physical -= da->capacity;
+        if(firstCount > (da->capacity - physical))
+            firstCount = da->capacity - physical;
+    }
+    runs[0] = daSlot(da, index);
+    counts[0] = firstCount;
+    if(firstCount == count)
+        return 1;
+    runs[1] = daSlot(da, index + firstCount);
+    counts[1] = count - firstCount;
+    return 2;
+}
+
+#endif
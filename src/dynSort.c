@@ -0,0 +1,622 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "dyn.h"
+#include "dynAtomic.h"
+#include "dynSlots.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ------------------------------------------------------------------------------------------------
+// Constants and Macros
+
+#define INSERTION_SORT_THRESHOLD 16  // partitions this small are finished off with insertion sort
+#define RADIX_SORT_THRESHOLD     64  // numeric arrays this small aren't worth the histogram passes
+#define SWAP_BUFFER_SIZE         64  // elements bigger than this get a heap-allocated swap buffer
+#define PARALLEL_SORT_THRESHOLD  8192 // arrays smaller than this just use daSort()
+#define MERGE_PIECES_PER_THREAD  2   // each merge round is cut into about this many pieces per thread
+
+#define elementAt(BASE, INDEX, SIZE) ((BASE) + ((INDEX) * (SIZE)))
+
+// ------------------------------------------------------------------------------------------------
+// Internal structures
+
+typedef struct dynSorter
+{
+    char *values;
+    dynSize elementSize;
+    dynCompareFunc compare;
+    char *temp; // one element of scratch space
+} dynSorter;
+
+typedef struct dynParallelSorter
+{
+    char *values;
+    dynSize elementSize;
+    dynCompareFunc compare;
+    int depthLimit;
+    dynSize *bounds;        // runCount + 1 run boundaries
+    int runCount;
+
+    // Current merge round
+    char *src;
+    char *dst;
+    int piecesPerPair;
+    long long itemCount;
+    dynAtomic64 nextItem;
+} dynParallelSorter;
+
+// ------------------------------------------------------------------------------------------------
+// Internal helper functions
+
+static void sortSwap(dynSorter *sorter, dynSize a, dynSize b)
+{
+    char *pa = elementAt(sorter->values, a, sorter->elementSize);
+    char *pb = elementAt(sorter->values, b, sorter->elementSize);
+    memcpy(sorter->temp, pa, sorter->elementSize);
+    memcpy(pa, pb, sorter->elementSize);
+    memcpy(pb, sorter->temp, sorter->elementSize);
+}
+
+static int sortCompare(dynSorter *sorter, dynSize a, dynSize b)
+{
+    return sorter->compare(elementAt(sorter->values, a, sorter->elementSize), elementAt(sorter->values, b, sorter->elementSize));
+}
+
+// sorts [start, end)
+static void sortInsertion(dynSorter *sorter, dynSize start, dynSize end)
+{
+    dynSize elementSize = sorter->elementSize;
+    dynSize i;
+    for(i = start + 1; i < end; ++i)
+    {
+        dynSize j = i;
+        char *p = elementAt(sorter->values, i, elementSize);
+        if(sorter->compare(elementAt(sorter->values, i - 1, elementSize), p) <= 0)
+            continue;
+
+        memcpy(sorter->temp, p, elementSize);
+        while((j > start) && (sorter->compare(elementAt(sorter->values, j - 1, elementSize), sorter->temp) > 0))
+            --j;
+        memmove(elementAt(sorter->values, j + 1, elementSize), elementAt(sorter->values, j, elementSize), (i - j) * elementSize);
+        memcpy(elementAt(sorter->values, j, elementSize), sorter->temp, elementSize);
+    }
+}
+
+static void sortSiftDown(dynSorter *sorter, dynSize start, dynSize root, dynSize count)
+{
+    for(;;)
+    {
+        dynSize child = (root * 2) + 1;
+        if(child >= count)
+            break;
+        if(((child + 1) < count) && (sortCompare(sorter, start + child, start + child + 1) < 0))
+            ++child;
+        if(sortCompare(sorter, start + root, start + child) >= 0)
+            break;
+        sortSwap(sorter, start + root, start + child);
+        root = child;
+    }
+}
+
+// sorts [start, end); used once introsort decides quicksort is going quadratic
+static void sortHeap(dynSorter *sorter, dynSize start, dynSize end)
+{
+    dynSize count = end - start;
+    dynSize i;
+    for(i = (count / 2) - 1; i >= 0; --i)
+        sortSiftDown(sorter, start, i, count);
+    for(i = count - 1; i > 0; --i)
+    {
+        sortSwap(sorter, start, start + i);
+        sortSiftDown(sorter, start, 0, i);
+    }
+}
+
+// sorts [start, end)
+static void sortIntro(dynSorter *sorter, dynSize start, dynSize end, int depthLimit)
+{
+    while((end - start) > INSERTION_SORT_THRESHOLD)
+    {
+        dynSize mid = start + ((end - start) / 2);
+        dynSize i, j;
+
+        if(depthLimit-- == 0)
+        {
+            sortHeap(sorter, start, end);
+            return;
+        }
+
+        // Median of three, parked at start as the pivot
+        if(sortCompare(sorter, mid, start) < 0)
+            sortSwap(sorter, mid, start);
+        if(sortCompare(sorter, end - 1, mid) < 0)
+        {
+            sortSwap(sorter, end - 1, mid);
+            if(sortCompare(sorter, mid, start) < 0)
+                sortSwap(sorter, mid, start);
+        }
+        sortSwap(sorter, start, mid);
+
+        // Hoare partition around the pivot at start
+        i = start;
+        j = end;
+        for(;;)
+        {
+            do { ++i; } while((i < end) && (sortCompare(sorter, i, start) < 0));
+            do { --j; } while(sortCompare(sorter, j, start) > 0);
+            if(i >= j)
+                break;
+            sortSwap(sorter, i, j);
+        }
+        sortSwap(sorter, start, j);
+
+        // Recurse into the smaller side, loop on the larger one
+        if((j - start) < (end - j - 1))
+        {
+            sortIntro(sorter, start, j, depthLimit);
+            start = j + 1;
+        }
+        else
+        {
+            sortIntro(sorter, j + 1, end, depthLimit);
+            end = j;
+        }
+    }
+    sortInsertion(sorter, start, end);
+}
+
+// sorts [start, end) using scratch (at least as big as the range)
+static void sortMerge(dynSorter *sorter, dynSize start, dynSize end, char *scratch)
+{
+    dynSize elementSize = sorter->elementSize;
+    dynSize mid, left, right, out;
+    if((end - start) <= INSERTION_SORT_THRESHOLD)
+    {
+        sortInsertion(sorter, start, end);
+        return;
+    }
+
+    mid = start + ((end - start) / 2);
+    sortMerge(sorter, start, mid, scratch);
+    sortMerge(sorter, mid, end, scratch);
+    if(sortCompare(sorter, mid - 1, mid) <= 0)
+        return; // already in order
+
+    memcpy(scratch, elementAt(sorter->values, start, elementSize), (mid - start) * elementSize);
+    left = 0;
+    right = mid;
+    out = start;
+    while((left < (mid - start)) && (right < end))
+    {
+        // Taking from the left on ties is what keeps this stable
+        if(sorter->compare(elementAt(sorter->values, right, elementSize), elementAt(scratch, left, elementSize)) < 0)
+            memcpy(elementAt(sorter->values, out++, elementSize), elementAt(sorter->values, right++, elementSize), elementSize);
+        else
+            memcpy(elementAt(sorter->values, out++, elementSize), elementAt(scratch, left++, elementSize), elementSize);
+    }
+    memcpy(elementAt(sorter->values, out, elementSize), elementAt(scratch, left, elementSize), ((mid - start) - left) * elementSize);
+}
+
+static int sortInit(dynSorter *sorter, void *daptr, void *compareFunc, char *swapBuffer)
+{
+    dynArray *da;
+    if(!daptr || !*(char **)daptr)
+        return 0;
+
+    daUnshare(daptr);
+    daLinearize(daptr);
+    da = dynValuesToArray((char **)daptr);
+    if(da->size < 2)
+        return 0;
+    sorter->values = *(char **)daptr;
+    sorter->elementSize = da->elementSize;
+    sorter->compare = (dynCompareFunc)compareFunc;
+    sorter->temp = (da->elementSize > SWAP_BUFFER_SIZE) ? (char *)malloc(da->elementSize) : swapBuffer;
+    return 1;
+}
+
+static void sortFinish(dynSorter *sorter, char *swapBuffer)
+{
+    if(sorter->temp != swapBuffer)
+        free(sorter->temp);
+}
+
+// Merge-path co-rank: how many of the output's first diagonal elements come from a (ties go to a)
+static dynSize sortCoRank(dynParallelSorter *ps, const char *a, dynSize aCount, const char *b, dynSize bCount, dynSize diagonal)
+{
+    dynSize elementSize = ps->elementSize;
+    dynSize lo = (diagonal > bCount) ? (diagonal - bCount) : 0;
+    dynSize hi = (diagonal < aCount) ? diagonal : aCount;
+    while(lo < hi)
+    {
+        dynSize i = lo + ((hi - lo) / 2);
+        if(ps->compare(elementAt(a, i, elementSize), elementAt(b, diagonal - i - 1, elementSize)) <= 0)
+            lo = i + 1;
+        else
+            hi = i;
+    }
+    return lo;
+}
+
+// Merges the output slice [outStart, outEnd) of the pair of runs starting at run index firstRun
+static void sortMergePiece(dynParallelSorter *ps, int firstRun, dynSize outStart, dynSize outEnd)
+{
+    dynSize elementSize = ps->elementSize;
+    dynSize runStart = ps->bounds[firstRun];
+    dynSize mid = ps->bounds[firstRun + 1];
+    const char *a = elementAt(ps->src, runStart, elementSize);
+    const char *b = elementAt(ps->src, mid, elementSize);
+    dynSize aCount = mid - runStart;
+    dynSize bCount = ps->bounds[firstRun + 2] - mid;
+    dynSize i = sortCoRank(ps, a, aCount, b, bCount, outStart);
+    dynSize j = outStart - i;
+    dynSize iEnd = sortCoRank(ps, a, aCount, b, bCount, outEnd);
+    dynSize jEnd = outEnd - iEnd;
+    char *out = elementAt(ps->dst, runStart + outStart, elementSize);
+
+    while((i < iEnd) && (j < jEnd))
+    {
+        if(ps->compare(elementAt(b, j, elementSize), elementAt(a, i, elementSize)) < 0)
+            memcpy(out, elementAt(b, j++, elementSize), elementSize);
+        else
+            memcpy(out, elementAt(a, i++, elementSize), elementSize);
+        out += elementSize;
+    }
+    memcpy(out, elementAt(a, i, elementSize), (iEnd - i) * elementSize);
+    out += (iEnd - i) * elementSize;
+    memcpy(out, elementAt(b, j, elementSize), (jEnd - j) * elementSize);
+}
+
+// Each pool thread sorts its own run in place
+static void sortParallelRun(int threadIndex, void *userData)
+{
+    dynParallelSorter *ps = (dynParallelSorter *)userData;
+    dynSorter sorter;
+    char swapBuffer[SWAP_BUFFER_SIZE];
+    sorter.values = ps->values;
+    sorter.elementSize = ps->elementSize;
+    sorter.compare = ps->compare;
+    sorter.temp = (ps->elementSize > SWAP_BUFFER_SIZE) ? (char *)malloc(ps->elementSize) : swapBuffer;
+    sortIntro(&sorter, ps->bounds[threadIndex], ps->bounds[threadIndex + 1], ps->depthLimit);
+    sortFinish(&sorter, swapBuffer);
+}
+
+// Pool threads pull pieces of the current merge round until there are none left
+static void sortParallelMerge(int threadIndex, void *userData)
+{
+    dynParallelSorter *ps = (dynParallelSorter *)userData;
+    long long item;
+    (void)threadIndex;
+    while((item = dynAtomicAdd64(&ps->nextItem, 1)) < ps->itemCount)
+    {
+        int pair = (int)(item / ps->piecesPerPair);
+        int firstRun = pair * 2;
+        dynSize runStart = ps->bounds[firstRun];
+        if((firstRun + 1) == ps->runCount)
+        {
+            // Odd run out, carried over untouched
+            dynSize count = ps->bounds[firstRun + 1] - runStart;
+            memcpy(elementAt(ps->dst, runStart, ps->elementSize), elementAt(ps->src, runStart, ps->elementSize), count * ps->elementSize);
+        }
+        else
+        {
+            long long piece = item % ps->piecesPerPair;
+            long long pairCount = ps->bounds[firstRun + 2] - runStart;
+            dynSize outStart = (dynSize)((pairCount * piece) / ps->piecesPerPair);
+            dynSize outEnd = (dynSize)((pairCount * (piece + 1)) / ps->piecesPerPair);
+            if(outStart < outEnd)
+                sortMergePiece(ps, firstRun, outStart, outEnd);
+        }
+    }
+}
+
+// LSD radix sort, a byte per pass, skipping any byte that every key shares
+#define RADIX_SORT(NAME, TYPE)                                                      \
+static void NAME(TYPE *keys, dynSize count)                                         \
+{                                                                                   \
+    dynSize histograms[sizeof(TYPE)][256];                                          \
+    TYPE *scratch = (TYPE *)malloc(count * sizeof(TYPE));                           \
+    TYPE *src = keys;                                                               \
+    TYPE *dst = scratch;                                                            \
+    TYPE *t;                                                                        \
+    dynSize i;                                                                      \
+    int pass;                                                                       \
+                                                                                    \
+    memset(histograms, 0, sizeof(histograms));                                      \
+    for(i = 0; i < count; ++i)                                                      \
+    {                                                                               \
+        for(pass = 0; pass < (int)sizeof(TYPE); ++pass)                             \
+            ++histograms[pass][(keys[i] >> (pass * 8)) & 0xff];                     \
+    }                                                                               \
+                                                                                    \
+    for(pass = 0; pass < (int)sizeof(TYPE); ++pass)                                 \
+    {                                                                               \
+        dynSize *histogram = histograms[pass];                                      \
+        dynSize offset = 0;                                                         \
+        int shift = pass * 8;                                                       \
+        int bucket;                                                                 \
+        if(histogram[(src[0] >> shift) & 0xff] == count)                            \
+            continue;                                                               \
+        for(bucket = 0; bucket < 256; ++bucket)                                     \
+        {                                                                           \
+            dynSize bucketCount = histogram[bucket];                                \
+            histogram[bucket] = offset;                                             \
+            offset += bucketCount;                                                  \
+        }                                                                           \
+        for(i = 0; i < count; ++i)                                                  \
+            dst[histogram[(src[i] >> shift) & 0xff]++] = src[i];                    \
+        t = src;                                                                    \
+        src = dst;                                                                  \
+        dst = t;                                                                    \
+    }                                                                               \
+    if(src != keys)                                                                 \
+        memcpy(keys, src, count * sizeof(TYPE));                                    \
+    free(scratch);                                                                  \
+}
+
+RADIX_SORT(radixSortU16, dynU16)
+RADIX_SORT(radixSortU32, dynU32)
+
+#undef RADIX_SORT
+
+static int compareU8(const dynU8 *a, const dynU8 *b)
+{
+    return (*a > *b) - (*a < *b);
+}
+
+static int compareU16(const dynU16 *a, const dynU16 *b)
+{
+    return (*a > *b) - (*a < *b);
+}
+
+static int compareU32(const dynU32 *a, const dynU32 *b)
+{
+    return (*a > *b) - (*a < *b);
+}
+
+static int compareF32(const dynF32 *a, const dynF32 *b)
+{
+    return (*a > *b) - (*a < *b);
+}
+
+// Returns the array's size if it holds elements of exactly elementSize (and linearizes it),
+// otherwise 0 so the caller can fall back to a comparison sort.
+static dynSize radixPrepare(void *daptr, dynSize elementSize)
+{
+    dynArray *da;
+    if(!daptr || !*(char **)daptr)
+        return 0;
+    da = dynValuesToArray((char **)daptr);
+    if(da->elementSize != elementSize)
+        return 0;
+    daUnshare(daptr);
+    daLinearize(daptr);
+    return dynValuesToArray((char **)daptr)->size;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Sorting
+
+void daSort(void *daptr, void * /*dynCompareFunc*/ compareFunc)
+{
+    dynSorter sorter;
+    char swapBuffer[SWAP_BUFFER_SIZE];
+    if(sortInit(&sorter, daptr, compareFunc, swapBuffer))
+    {
+        dynSize size = daSize(daptr);
+        int depthLimit = 0;
+        dynSize n;
+        for(n = size; n > 1; n >>= 1)
+            depthLimit += 2;
+        sortIntro(&sorter, 0, size, depthLimit);
+        sortFinish(&sorter, swapBuffer);
+    }
+}
+
+void daStableSort(void *daptr, void * /*dynCompareFunc*/ compareFunc)
+{
+    dynSorter sorter;
+    char swapBuffer[SWAP_BUFFER_SIZE];
+    if(sortInit(&sorter, daptr, compareFunc, swapBuffer))
+    {
+        dynSize size = daSize(daptr);
+        char *scratch = (char *)malloc(((size / 2) + 1) * sorter.elementSize);
+        sortMerge(&sorter, 0, size, scratch);
+        free(scratch);
+        sortFinish(&sorter, swapBuffer);
+    }
+}
+
+void daParallelSort(void *daptr, void * /*dynCompareFunc*/ compareFunc)
+{
+    dynThreadPool *pool = dtDefaultPool();
+    int threadCount = dtPoolThreadCount(pool);
+    dynParallelSorter ps;
+    char *scratch;
+    dynSize size = daSize(daptr);
+    dynSize n;
+    int i;
+
+    if((threadCount < 2) || (size < PARALLEL_SORT_THRESHOLD))
+    {
+        daSort(daptr, compareFunc);
+        return;
+    }
+
+    daUnshare(daptr);
+    daLinearize(daptr);
+    ps.values = *(char **)daptr;
+    ps.elementSize = dynValuesToArray((char **)daptr)->elementSize;
+    ps.compare = (dynCompareFunc)compareFunc;
+    ps.depthLimit = 0;
+    for(n = size / threadCount; n > 1; n >>= 1)
+        ps.depthLimit += 2;
+    ps.runCount = threadCount;
+    ps.bounds = (dynSize *)malloc((threadCount + 1) * sizeof(dynSize));
+    for(i = 0; i <= threadCount; ++i)
+        ps.bounds[i] = (dynSize)(((long long)size * i) / threadCount);
+
+    // Sort one run per thread, then merge pairs of runs (ping-ponging through scratch) until one
+    // is left. Every merge is split along its merge path so all threads stay busy to the end.
+    dtPoolRun(pool, sortParallelRun, &ps);
+
+    scratch = (char *)malloc((size_t)size * ps.elementSize);
+    ps.src = ps.values;
+    ps.dst = scratch;
+    while(ps.runCount > 1)
+    {
+        int pairCount = ps.runCount / 2;
+        int leftover = ps.runCount & 1;
+        char *swap;
+
+        ps.piecesPerPair = ((threadCount * MERGE_PIECES_PER_THREAD) + pairCount - 1) / pairCount;
+        ps.itemCount = ((long long)pairCount * ps.piecesPerPair) + leftover; // the odd run out is one item
+        dynAtomicStore64(&ps.nextItem, 0);
+        dtPoolRun(pool, sortParallelMerge, &ps);
+
+        for(i = 0; i <= pairCount; ++i)
+            ps.bounds[i] = ps.bounds[i * 2];
+        if(leftover)
+            ps.bounds[pairCount + 1] = ps.bounds[ps.runCount];
+        ps.runCount = pairCount + leftover;
+
+        swap = ps.src;
+        ps.src = ps.dst;
+        ps.dst = swap;
+    }
+    if(ps.src != ps.values)
+        memcpy(ps.values, ps.src, (size_t)size * ps.elementSize);
+
+    free(scratch);
+    free(ps.bounds);
+}
+
+void daSortU8(void *daptr)
+{
+    dynSize size = radixPrepare(daptr, sizeof(dynU8));
+    if(size > RADIX_SORT_THRESHOLD)
+    {
+        // A single counting pass is all a byte needs
+        dynU8 *values = *(dynU8 **)daptr;
+        dynSize counts[256];
+        dynSize i;
+        int value;
+        memset(counts, 0, sizeof(counts));
+        for(i = 0; i < size; ++i)
+            ++counts[values[i]];
+        for(value = 0; value < 256; ++value)
+        {
+            memset(values, value, counts[value]);
+            values += counts[value];
+        }
+    }
+    else if(daptr && *(char **)daptr)
+    {
+        daSort(daptr, compareU8);
+    }
+}
+
+void daSortU16(void *daptr)
+{
+    dynSize size = radixPrepare(daptr, sizeof(dynU16));
+    if(size > RADIX_SORT_THRESHOLD)
+        radixSortU16(*(dynU16 **)daptr, size);
+    else if(daptr && *(char **)daptr)
+        daSort(daptr, compareU16);
+}
+
+void daSortU32(void *daptr)
+{
+    dynSize size = radixPrepare(daptr, sizeof(dynU32));
+    if(size > RADIX_SORT_THRESHOLD)
+        radixSortU32(*(dynU32 **)daptr, size);
+    else if(daptr && *(char **)daptr)
+        daSort(daptr, compareU32);
+}
+
+void daSortF32(void *daptr)
+{
+    dynSize size = radixPrepare(daptr, sizeof(dynF32));
+    if((size > RADIX_SORT_THRESHOLD) && (sizeof(dynF32) == sizeof(dynU32)))
+    {
+        // Flip the float bits so that unsigned integer order matches float order: negative
+        // values get every bit flipped, positive values just the sign bit.
+        union { dynF32 f; dynU32 u; } *values = *(void **)daptr;
+        dynSize i;
+        for(i = 0; i < size; ++i)
+        {
+            dynU32 u = values[i].u;
+            values[i].u = u ^ ((u & 0x80000000) ? 0xffffffff : 0x80000000);
+        }
+        radixSortU32((dynU32 *)values, size);
+        for(i = 0; i < size; ++i)
+        {
+            dynU32 u = values[i].u;
+            values[i].u = u ^ ((u & 0x80000000) ? 0x80000000 : 0xffffffff);
+        }
+    }
+    else if(daptr && *(char **)daptr)
+    {
+        daSort(daptr, compareF32);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Searching
+
+// Searches never linearize (or otherwise touch) the array, so they're safe on a deque or a
+// daClone() snapshot that other threads are reading too
+static dynArray *searchArray(void *daptr)
+{
+    return (daptr && *(char **)daptr) ? dynValuesToArray((char **)daptr) : NULL;
+}
+
+dynSize daLowerBound(void *daptr, const void *key, void * /*dynCompareFunc*/ compareFunc)
+{
+    dynCompareFunc compare = (dynCompareFunc)compareFunc;
+    dynArray *da = searchArray(daptr);
+    dynSize lo = 0;
+    dynSize hi = da ? da->size : 0;
+    while(lo < hi)
+    {
+        dynSize mid = lo + ((hi - lo) / 2);
+        if(compare(daSlot(da, mid), key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+dynSize daUpperBound(void *daptr, const void *key, void * /*dynCompareFunc*/ compareFunc)
+{
+    dynCompareFunc compare = (dynCompareFunc)compareFunc;
+    dynArray *da = searchArray(daptr);
+    dynSize lo = 0;
+    dynSize hi = da ? da->size : 0;
+    while(lo < hi)
+    {
+        dynSize mid = lo + ((hi - lo) / 2);
+        if(compare(daSlot(da, mid), key) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+dynSize daBinarySearch(void *daptr, const void *key, void * /*dynCompareFunc*/ compareFunc)
+{
+    dynCompareFunc compare = (dynCompareFunc)compareFunc;
+    dynArray *da = searchArray(daptr);
+    dynSize index = daLowerBound(daptr, key, compareFunc);
+    if(da && (index < da->size) && (compare(daSlot(da, index), key) == 0))
+        return index;
+    return -1;
+}
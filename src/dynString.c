@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #if defined(_WIN32) && !defined(va_copy)
 #define va_copy(dest, src) ((void)((dest) = (src)))
@@ -18,79 +19,180 @@
 // ------------------------------------------------------------------------------------------------
 // Constants
 
+#define DS_MIN_GROWTH 15                  // first append reserves at least this many chars (16 with the terminator)
+#define DS_HUGE_GROWTH (1024 * 1024)      // past this, appends grow capacity by a quarter instead of doubling
+
 // ------------------------------------------------------------------------------------------------
 // Internal structures
 
-typedef struct dynString
-{
-    char *buffer;
-    int length;
-    int capacity;
-} dynString;
+// The header layout lives in dyn.h, for the inline fast paths. Every string is one block:
+// [length][capacity][flags][chars...][0], with length/capacity as wide as the flags say.
+
+#define DS_LENGTH 0
+#define DS_CAPACITY 1
+
+#define DSF_FOREIGN (DSF_STORAGE | DSF_STATIC) // blocks dyn didn't malloc, so it can't realloc or free them
+
+#define dsFlags(STR) (((unsigned char *)(STR))[-1])
+#define dsType(STR) (dsFlags(STR) & DSH_TYPE_MASK)
+#define dsBlock(STR) ((STR) - dynStringHeaderSize(dsType(STR)))
+
+// The shared empty string: a DSH_8 header with length and capacity 0, then the terminator
+static char dsEmptyBlock[4] = { 0, 0, DSH_8 | DSF_STATIC, 0 };
+#define dsEmpty (dsEmptyBlock + 3)
 
 // ------------------------------------------------------------------------------------------------
 // Internal helper functions
 
-// workhorse function that does all of the allocation and copying
-static dynString *dsChangeCapacity(dynSize newCapacity, char **prevptr)
+// smallest header type that can hold capacity
+static int dsTypeFor(dynSize capacity)
 {
-    dynString *newString;
-    dynString *prevString = NULL;
-    if(prevptr && *prevptr)
-    {
-        prevString = (dynString *)((char *)(*prevptr) - sizeof(dynString));
-        if(newCapacity == prevString->capacity)
-            return prevString;
-    }
+    if(capacity < 256)
+        return DSH_8;
+    if(capacity < 65536)
+        return DSH_16;
+    if((unsigned long long)capacity < 0x100000000ULL)
+        return DSH_32;
+    return DSH_64;
+}
 
-    newString = (dynString *)calloc(1, sizeof(dynString) + (sizeof(char) * (newCapacity + 1)));
-    newString->capacity = newCapacity;
-    newString->buffer = ((char *)newString) + sizeof(dynString);
-    if(prevptr)
+static void dsSetField(char *str, int field, dynSize value)
+{
+    unsigned char *flags = (unsigned char *)str - 1;
+    switch(*flags & DSH_TYPE_MASK)
     {
-        if(prevString)
+        case DSH_8:
+            flags[field - 2] = (dynU8)value;
+            break;
+        case DSH_16:
+        {
+            dynU16 v = (dynU16)value;
+            memcpy(flags - ((2 - field) * sizeof(v)), &v, sizeof(v));
+            break;
+        }
+        case DSH_32:
+        {
+            dynU32 v = (dynU32)value;
+            memcpy(flags - ((2 - field) * sizeof(v)), &v, sizeof(v));
+            break;
+        }
+        default:
         {
-            int copyCount = prevString->length;
-            if(copyCount > newString->capacity)
-                copyCount = newString->capacity;
-            memcpy(newString->buffer, prevString->buffer, sizeof(char) * (copyCount + 1)); // + null terminator
-            newString->length = copyCount;
-            free(prevString);
+            dynU64 v = (dynU64)value;
+            memcpy(flags - ((2 - field) * sizeof(v)), &v, sizeof(v));
+            break;
         }
-        *prevptr = newString->buffer;
     }
-    return newString;
 }
 
-// finds / lazily creates a dynString from a regular ptr*
-static dynString *dsGet(char **dsptr, int autoCreate)
+// sets the length and terminates; the shared empty string is never written to (it can only ever be
+// "set" to a length of 0 anyway, as its capacity is 0)
+static void dsSetLengthField(char *str, dynSize length)
 {
-    dynString *ds = NULL;
-    if(dsptr && *dsptr)
+    if(!(dsFlags(str) & DSF_STATIC))
     {
-        // Move backwards one struct's worth (in bytes) to find the actual struct
-        ds = (dynString *)((char *)(*dsptr) - sizeof(dynString));
+        dsSetField(str, DS_LENGTH, length);
+        str[length] = 0;
+    }
+}
+
+// workhorse function that does all of the allocation and copying
+static char *dsChangeCapacity(dynSize newCapacity, char **dsptr)
+{
+    char *prev = *dsptr;
+    int type = dsTypeFor(newCapacity);
+    size_t headerSize = dynStringHeaderSize(type);
+    dynSize length = 0;
+    char *block;
+    char *str;
+
+    if(prev)
+    {
+        if(newCapacity == dsHeaderField(prev, DS_CAPACITY))
+            return prev;
+        length = dsHeaderField(prev, DS_LENGTH);
+        if(length > newCapacity)
+            length = newCapacity;
+        if((dsFlags(prev) & DSF_FOREIGN) && (newCapacity < dsHeaderField(prev, DS_CAPACITY)))
+        {
+            // Caller-provided storage never shrinks; just drop what no longer fits
+            dsSetLengthField(prev, length);
+            return prev;
+        }
+    }
+
+    if((newCapacity < 0) || ((unsigned long long)newCapacity > ((unsigned long long)dynSizeMax - headerSize - 1))
+       || ((unsigned long long)newCapacity > ((unsigned long long)SIZE_MAX - headerSize - 1)))
+        abort(); // see daAllocSize()
+    if(prev && !(dsFlags(prev) & DSF_FOREIGN) && (dsType(prev) == type))
+    {
+        // Same header: realloc can often extend in place. New space is zeroed to match calloc below
+        dynSize prevCapacity = dsHeaderField(prev, DS_CAPACITY);
+        block = (char *)realloc(dsBlock(prev), headerSize + (sizeof(char) * ((size_t)newCapacity + 1)));
+        if(!block)
+            abort();
+        str = block + headerSize;
+        if(newCapacity > prevCapacity)
+            memset(str + prevCapacity + 1, 0, sizeof(char) * (size_t)(newCapacity - prevCapacity));
     }
     else
     {
-        if(autoCreate)
+        block = (char *)calloc(1, headerSize + (sizeof(char) * ((size_t)newCapacity + 1)));
+        if(!block)
+            abort();
+        str = block + headerSize;
+        dsFlags(str) = (unsigned char)type;
+        if(prev)
         {
-            // Create a new dynamic array
-            ds = dsChangeCapacity(0, dsptr);
+            memcpy(str, prev, sizeof(char) * (size_t)length);
+            if(!(dsFlags(prev) & DSF_FOREIGN))
+                free(dsBlock(prev));
         }
     }
-    return ds;
+    dsSetField(str, DS_CAPACITY, newCapacity);
+    dsSetLengthField(str, length);
+    *dsptr = str;
+    return str;
 }
 
-// calls dsChangeCapacity in preparation for new dsta, if necessary
-static dynString *dsMakeRoom(char **dsptr, int len, int append)
+// Appends grow geometrically so a loop of dsConcat()s costs amortized O(1) per char
+static dynSize dsNextCapacity(dynSize capacity, dynSize capacityNeeded)
 {
-    int currCapacity = dsCapacity(dsptr);
-    int capacityNeeded = len;
+    if(capacity < DS_MIN_GROWTH)
+        capacity = DS_MIN_GROWTH;
+    while(capacity < capacityNeeded)
+    {
+        dynSize step = (capacity > DS_HUGE_GROWTH) ? (capacity / 4) : capacity;
+        if(step > (dynSizeMax - capacity))
+            return capacityNeeded; // can't grow by that much; take exactly what's needed
+        capacity += step;
+    }
+    return capacity;
+}
+
+// finds / lazily creates the string; a new one is the shared empty string
+static char *dsGet(char **dsptr, int autoCreate)
+{
+    if(!*dsptr && autoCreate)
+        *dsptr = dsEmpty;
+    return *dsptr;
+}
+
+// calls dsChangeCapacity in preparation for new data, if necessary
+static char *dsMakeRoom(char **dsptr, dynSize len, int append)
+{
+    dynSize currCapacity = dsCapacity(dsptr);
+    dynSize capacityNeeded = len;
     if(append)
+    {
+        if(len > (dynSizeMax - dsLength(dsptr)))
+            abort();
         capacityNeeded += dsLength(dsptr);
+    }
     if(capacityNeeded > currCapacity)
     {
+        if(append)
+            capacityNeeded = dsNextCapacity(currCapacity, capacityNeeded);
         return dsChangeCapacity(capacityNeeded, dsptr);
     }
     return dsGet(dsptr, 1);
@@ -104,13 +206,43 @@ void dsCreate(char **dsptr)
     dsClear(dsptr);
 }
 
+void dsCreateWithStorage(char **dsptr, void *storage, size_t storageBytes)
+{
+    int type = DSH_8;
+    size_t capacity;
+    char *str;
+
+    if(*dsptr)
+        return; // already created, same as dsCreate()
+    if(!storage || (storageBytes < (dynStringHeaderSize(DSH_8) + 1)))
+    {
+        dsCreate(dsptr); // too small to hold even the terminator; start out empty instead
+        return;
+    }
+    for( ; type < DSH_64; ++type)
+    {
+        // the narrowest header whose fields can hold whatever capacity is left over
+        if((unsigned long long)(storageBytes - dynStringHeaderSize(type) - 1) < (1ULL << (8 << type)))
+            break;
+    }
+    capacity = storageBytes - dynStringHeaderSize(type) - 1;
+    if(capacity > (size_t)dynSizeMax)
+        capacity = (size_t)dynSizeMax;
+
+    str = (char *)storage + dynStringHeaderSize(type);
+    dsFlags(str) = (unsigned char)(type | DSF_STORAGE);
+    dsSetField(str, DS_CAPACITY, (dynSize)capacity);
+    dsSetLengthField(str, 0);
+    *dsptr = str;
+}
+
 void dsDestroy(char **dsptr)
 {
-    dynString *ds = dsGet(dsptr, 0);
-    if(ds)
+    char *str = *dsptr;
+    if(str)
     {
-        dsClear(dsptr);
-        free(ds);
+        if(!(dsFlags(str) & DSF_FOREIGN))
+            free(dsBlock(str));
         *dsptr = 0;
     }
 }
@@ -123,9 +255,7 @@ void dsDestroyIndirect(char *ds)
 
 void dsClear(char **dsptr)
 {
-    dynString *ds = dsGet(dsptr, 1);
-    ds->buffer[0] = 0;
-    ds->length = 0;
+    dsSetLengthField(dsGet(dsptr, 1), 0);
 }
 
 char *dsDup(const char *text)
@@ -151,10 +281,9 @@ char *dsDupf(const char *format, ...)
 
 void dsCopyLen(char **dsptr, const char *text, dynSize len)
 {
-    dynString *ds = dsMakeRoom(dsptr, len, 0);
-    memcpy(ds->buffer, text, len);
-    ds->length = len;
-    ds->buffer[ds->length] = 0;
+    char *str = dsMakeRoom(dsptr, len, 0);
+    memcpy(str, text, len);
+    dsSetLengthField(str, len);
 }
 
 void dsCopy(char **dsptr, const char *text)
@@ -164,10 +293,10 @@ void dsCopy(char **dsptr, const char *text)
 
 void dsConcatLen(char **dsptr, const char *text, dynSize len)
 {
-    dynString *ds = dsMakeRoom(dsptr, len, 1);
-    memcpy(ds->buffer + ds->length, text, len);
-    ds->length += len;
-    ds->buffer[ds->length] = 0;
+    char *str = dsMakeRoom(dsptr, len, 1);
+    dynSize length = dsHeaderField(str, DS_LENGTH);
+    memcpy(str + length, text, len);
+    dsSetLengthField(str, length + len);
 }
 
 void dsConcat(char **dsptr, const char *text)
@@ -186,7 +315,8 @@ void dsPrintf(char **dsptr, const char *format, ...)
 
 void dsConcatv(char **dsptr, const char *format, va_list args)
 {
-    dynString *ds;
+    char *str;
+    dynSize length;
     int textLen;
     va_list argsCopy;
     va_copy(argsCopy, args);
@@ -200,9 +330,10 @@ void dsConcatv(char **dsptr, const char *format, va_list args)
         return;
     }
 
-    ds = dsMakeRoom(dsptr, textLen, 1);
-    vsnprintf(ds->buffer + ds->length, textLen + 1, format, args);
-    ds->length += textLen;
+    str = dsMakeRoom(dsptr, textLen, 1);
+    length = dsHeaderField(str, DS_LENGTH);
+    vsnprintf(str + length, textLen + 1, format, args);
+    dsSetLengthField(str, length + textLen);
 }
 
 void dsConcatf(char **dsptr, const char *format, ...)
@@ -215,40 +346,50 @@ void dsConcatf(char **dsptr, const char *format, ...)
 
 void dsSetLength(char **dsptr, dynSize newLength)
 {
-    dynString *ds;
+    char *str;
 
     if(dsLength(dsptr) == newLength)
         return;
 
     if(newLength > dsCapacity(dsptr))
     {
-        ds = dsChangeCapacity(newLength, dsptr);
+        str = dsChangeCapacity(newLength, dsptr);
     }
     else
     {
-        ds = dsGet(dsptr, 1);
+        str = dsGet(dsptr, 1);
     }
-    if(newLength > ds->length)
-    {
-        //memset(ds->buffer + ds->length, ' ', sizeof(char) * (newLength - ds->length));
-    }
-    ds->length = newLength;
-    ds->buffer[ds->length] = 0;
+    dsSetLengthField(str, newLength);
 }
 
 void dsCalcLength(char **dsptr)
 {
-    dynString *ds = dsGet(dsptr, 0);
-    if(ds)
+    char *str = dsGet(dsptr, 0);
+    if(str)
     {
-        dsSetLength(dsptr, (int)strlen(ds->buffer));
+        dsSetLength(dsptr, (dynSize)strlen(str));
     }
 }
 
 void dsSetCapacity(char **dsptr, dynSize newCapacity)
 {
-    dynString *ds = dsChangeCapacity(newCapacity, dsptr);
-    ds->buffer[ds->length] = 0;
+    dsGet(dsptr, 1);
+    dsChangeCapacity(newCapacity, dsptr);
+}
+
+void dsReserve(char **dsptr, dynSize capacity)
+{
+    if(capacity > dsCapacity(dsptr))
+        dsChangeCapacity(capacity, dsptr);
+    else
+        dsGet(dsptr, 1);
+}
+
+void dsShrinkToFit(char **dsptr)
+{
+    char *str = dsGet(dsptr, 0);
+    if(str)
+        dsChangeCapacity(dsHeaderField(str, DS_LENGTH), dsptr);
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -266,22 +407,12 @@ int dsCmp(char **dsptr, char **other)
     return strcmp(s1, s2);
 }
 
-dynSize dsLength(char **dsptr)
+dynSize (dsLength)(char **dsptr)
 {
-    dynString *ds = dsGet(dsptr, 0);
-    if(ds)
-    {
-        return ds->length;
-    }
-    return 0;
+    return dsLengthInline(dsptr);
 }
 
-dynSize dsCapacity(char **dsptr)
+dynSize (dsCapacity)(char **dsptr)
 {
-    dynString *ds = dsGet(dsptr, 0);
-    if(ds)
-    {
-        return ds->capacity;
-    }
-    return 0;
+    return dsCapacityInline(dsptr);
 }
@@ -0,0 +1,549 @@
+// ---------------------------------------------------------------------------
+//                         Copyright Joe Drago 2012.
+//         Distributed under the Boost Software License, Version 1.0.
+//            (See accompanying file LICENSE_1_0.txt or copy at
+//                  http://www.boost.org/LICENSE_1_0.txt)
+// ---------------------------------------------------------------------------
+
+#include "dyn.h"
+#include "dynAtomic.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+// ------------------------------------------------------------------------------------------------
+// Constants and Macros
+
+#define MAX_CHUNKS 0x7fffffff // parallel-for chunk indices are packed two to a 64 bit word
+
+#define packRange(BEGIN, END) ((long long)(((unsigned long long)(END) << 32) | (unsigned long long)(BEGIN)))
+#define rangeBegin(RANGE) ((long long)((unsigned long long)(RANGE) & 0xffffffff))
+#define rangeEnd(RANGE) ((long long)((unsigned long long)(RANGE) >> 32))
+
+// ------------------------------------------------------------------------------------------------
+// Internal structures
+
+typedef struct dynThreadJob
+{
+    dynThreadFunc func;
+    void *userData;
+    int threadIndex;
+} dynThreadJob;
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION dtMutex;
+typedef CONDITION_VARIABLE dtCond;
+typedef HANDLE dtThread;
+#else
+typedef pthread_mutex_t dtMutex;
+typedef pthread_cond_t dtCond;
+typedef pthread_t dtThread;
+#endif
+
+typedef struct dynThreadPoolWorker
+{
+    struct dynThreadPool *pool;
+    dtThread thread;
+    int threadIndex;
+    int started;
+} dynThreadPoolWorker;
+
+struct dynThreadPool
+{
+    int threadCount;              // including the thread calling dtPoolRun()
+    dynThreadPoolWorker *workers; // [0] is unused; the caller is worker 0
+    dtMutex mutex;
+    dtCond wake;                  // signalled when a new generation of work is posted
+    dtCond done;                  // signalled when the last worker finishes a generation
+    dynThreadFunc func;
+    void *userData;
+    int generation;
+    int remaining;
+    int shuttingDown;
+    dynAtomic64 busy;             // non-zero while a dtPoolRun() is in flight
+};
+
+typedef struct dtParallelForJob
+{
+    void *daptr;
+    dynParallelForFunc func;
+    void *userData;
+    dynSize size;
+    dynSize grainSize;
+    dynAtomic64 *ranges; // one packed [begin, end) chunk range per worker
+    int workerCount;
+} dtParallelForJob;
+
+static dynAtomicPtr defaultPool = NULL;
+
+// ------------------------------------------------------------------------------------------------
+// Internal helper functions
+
+#ifdef _WIN32
+static DWORD WINAPI dtJobMain(LPVOID p)
+{
+    dynThreadJob *job = (dynThreadJob *)p;
+    job->func(job->threadIndex, job->userData);
+    return 0;
+}
+#else
+static void *dtJobMain(void *p)
+{
+    dynThreadJob *job = (dynThreadJob *)p;
+    job->func(job->threadIndex, job->userData);
+    return NULL;
+}
+#endif
+
+static void dtMutexInit(dtMutex *mutex)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static void dtMutexDestroy(dtMutex *mutex)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+static void dtMutexLock(dtMutex *mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+static void dtMutexUnlock(dtMutex *mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+static void dtCondInit(dtCond *cond)
+{
+#ifdef _WIN32
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+static void dtCondDestroy(dtCond *cond)
+{
+#ifdef _WIN32
+    (void)cond; // nothing to release
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+static void dtCondWait(dtCond *cond, dtMutex *mutex)
+{
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+static void dtCondBroadcast(dtCond *cond)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+static void dtPoolWorkerLoop(dynThreadPoolWorker *worker)
+{
+    dynThreadPool *pool = worker->pool;
+    int seenGeneration = 0;
+    for(;;)
+    {
+        dynThreadFunc func;
+        void *userData;
+
+        dtMutexLock(&pool->mutex);
+        while((pool->generation == seenGeneration) && !pool->shuttingDown)
+            dtCondWait(&pool->wake, &pool->mutex);
+        if(pool->shuttingDown)
+        {
+            dtMutexUnlock(&pool->mutex);
+            return;
+        }
+        seenGeneration = pool->generation;
+        func = pool->func;
+        userData = pool->userData;
+        dtMutexUnlock(&pool->mutex);
+
+        func(worker->threadIndex, userData);
+
+        dtMutexLock(&pool->mutex);
+        if(--pool->remaining == 0)
+            dtCondBroadcast(&pool->done);
+        dtMutexUnlock(&pool->mutex);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI dtPoolWorkerMain(LPVOID p)
+{
+    dtPoolWorkerLoop((dynThreadPoolWorker *)p);
+    return 0;
+}
+#else
+static void *dtPoolWorkerMain(void *p)
+{
+    dtPoolWorkerLoop((dynThreadPoolWorker *)p);
+    return NULL;
+}
+#endif
+
+// Pops the next chunk off the front of a worker's own range
+static int dtClaimChunk(dynAtomic64 *range, long long *chunk)
+{
+    for(;;)
+    {
+        long long current = dynAtomicLoad64(range);
+        long long begin = rangeBegin(current);
+        long long end = rangeEnd(current);
+        if(begin >= end)
+            return 0;
+        if(dynAtomicCAS64(range, current, packRange(begin + 1, end)))
+        {
+            *chunk = begin;
+            return 1;
+        }
+    }
+}
+
+// Steals the back half of some other worker's range into the thief's own (empty) range
+static int dtStealChunks(dtParallelForJob *job, int thiefIndex)
+{
+    int i;
+    for(i = 1; i < job->workerCount; ++i)
+    {
+        dynAtomic64 *victim = &job->ranges[(thiefIndex + i) % job->workerCount];
+        for(;;)
+        {
+            long long current = dynAtomicLoad64(victim);
+            long long begin = rangeBegin(current);
+            long long end = rangeEnd(current);
+            long long mid = end - (((end - begin) + 1) / 2);
+            if(begin >= end)
+                break;
+            if(dynAtomicCAS64(victim, current, packRange(begin, mid)))
+            {
+                dynAtomicStore64(&job->ranges[thiefIndex], packRange(mid, end));
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void dtParallelForWorker(int threadIndex, void *userData)
+{
+    dtParallelForJob *job = (dtParallelForJob *)userData;
+    if(threadIndex >= job->workerCount)
+        return; // more pool threads than chunks
+    do
+    {
+        long long chunk;
+        while(dtClaimChunk(&job->ranges[threadIndex], &chunk))
+        {
+            dynSize start = (dynSize)chunk * job->grainSize;
+            dynSize end = start + job->grainSize;
+            if(end > job->size)
+                end = job->size;
+            job->func(job->daptr, start, end, job->userData);
+        }
+    } while(dtStealChunks(job, threadIndex));
+}
+
+// ------------------------------------------------------------------------------------------------
+// Threads
+
+int dtCPUCount(void)
+{
+    int count = 1;
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    count = (int)info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if(count < 1)
+        count = 1;
+    return count;
+}
+
+void dtRun(int threadCount, void * /*dynThreadFunc*/ func, void *userData)
+{
+    dynThreadJob *jobs;
+#ifdef _WIN32
+    HANDLE *threads;
+#else
+    pthread_t *threads;
+    int *started;
+#endif
+    int i;
+
+    if(threadCount < 1)
+        threadCount = 1;
+
+    jobs = (dynThreadJob *)calloc(threadCount, sizeof(dynThreadJob));
+    for(i = 0; i < threadCount; ++i)
+    {
+        jobs[i].func = (dynThreadFunc)func;
+        jobs[i].userData = userData;
+        jobs[i].threadIndex = i;
+    }
+
+    // Index 0 always runs on the calling thread; if a thread can't be spawned,
+    // its job is run inline after the others are joined, so every index still runs.
+#ifdef _WIN32
+    threads = (HANDLE *)calloc(threadCount, sizeof(HANDLE));
+    for(i = 1; i < threadCount; ++i)
+    {
+        threads[i] = CreateThread(NULL, 0, dtJobMain, &jobs[i], 0, NULL);
+    }
+    dtJobMain(&jobs[0]);
+    for(i = 1; i < threadCount; ++i)
+    {
+        if(threads[i])
+        {
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+        }
+        else
+        {
+            dtJobMain(&jobs[i]);
+        }
+    }
+#else
+    threads = (pthread_t *)calloc(threadCount, sizeof(pthread_t));
+    started = (int *)calloc(threadCount, sizeof(int));
+    for(i = 1; i < threadCount; ++i)
+    {
+        started[i] = (pthread_create(&threads[i], NULL, dtJobMain, &jobs[i]) == 0);
+    }
+    dtJobMain(&jobs[0]);
+    for(i = 1; i < threadCount; ++i)
+    {
+        if(started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+        else
+        {
+            dtJobMain(&jobs[i]);
+        }
+    }
+    free(started);
+#endif
+    free(threads);
+    free(jobs);
+}
+
+void dtYield(void)
+{
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+// Thread pools
+
+dynThreadPool *dtPoolCreate(int threadCount)
+{
+    dynThreadPool *pool = (dynThreadPool *)calloc(1, sizeof(dynThreadPool));
+    int i;
+    if(threadCount < 1)
+        threadCount = dtCPUCount();
+
+    pool->threadCount = threadCount;
+    pool->workers = (dynThreadPoolWorker *)calloc(threadCount, sizeof(dynThreadPoolWorker));
+    dtMutexInit(&pool->mutex);
+    dtCondInit(&pool->wake);
+    dtCondInit(&pool->done);
+    for(i = 1; i < threadCount; ++i)
+    {
+        dynThreadPoolWorker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->threadIndex = i;
+#ifdef _WIN32
+        worker->thread = CreateThread(NULL, 0, dtPoolWorkerMain, worker, 0, NULL);
+        worker->started = (worker->thread != NULL);
+#else
+        worker->started = (pthread_create(&worker->thread, NULL, dtPoolWorkerMain, worker) == 0);
+#endif
+    }
+    return pool;
+}
+
+void dtPoolDestroy(dynThreadPool *pool)
+{
+    int i;
+    if(!pool)
+        return;
+
+    dtMutexLock(&pool->mutex);
+    pool->shuttingDown = 1;
+    dtCondBroadcast(&pool->wake);
+    dtMutexUnlock(&pool->mutex);
+    for(i = 1; i < pool->threadCount; ++i)
+    {
+        dynThreadPoolWorker *worker = &pool->workers[i];
+        if(worker->started)
+        {
+#ifdef _WIN32
+            WaitForSingleObject(worker->thread, INFINITE);
+            CloseHandle(worker->thread);
+#else
+            pthread_join(worker->thread, NULL);
+#endif
+        }
+    }
+    dtCondDestroy(&pool->done);
+    dtCondDestroy(&pool->wake);
+    dtMutexDestroy(&pool->mutex);
+    free(pool->workers);
+    free(pool);
+}
+
+int dtPoolThreadCount(dynThreadPool *pool)
+{
+    return pool ? pool->threadCount : 1;
+}
+
+void dtPoolRun(dynThreadPool *pool, void * /*dynThreadFunc*/ func, void *userData)
+{
+    dynThreadFunc threadFunc = (dynThreadFunc)func;
+    int i;
+
+    if(!pool || !dynAtomicCAS64(&pool->busy, 0, 1))
+    {
+        // Nested (or concurrent) use of a busy pool: just do the work right here
+        int threadCount = dtPoolThreadCount(pool);
+        for(i = 0; i < threadCount; ++i)
+            threadFunc(i, userData);
+        return;
+    }
+
+    dtMutexLock(&pool->mutex);
+    pool->func = threadFunc;
+    pool->userData = userData;
+    pool->remaining = 0;
+    for(i = 1; i < pool->threadCount; ++i)
+    {
+        if(pool->workers[i].started)
+            ++pool->remaining;
+    }
+    ++pool->generation;
+    dtCondBroadcast(&pool->wake);
+    dtMutexUnlock(&pool->mutex);
+
+    threadFunc(0, userData);
+    for(i = 1; i < pool->threadCount; ++i)
+    {
+        if(!pool->workers[i].started)
+            threadFunc(i, userData); // couldn't spawn this one; cover for it
+    }
+
+    dtMutexLock(&pool->mutex);
+    while(pool->remaining > 0)
+        dtCondWait(&pool->done, &pool->mutex);
+    dtMutexUnlock(&pool->mutex);
+
+    dynAtomicStore64(&pool->busy, 0);
+}
+
+dynThreadPool *dtDefaultPool(void)
+{
+    dynThreadPool *pool = (dynThreadPool *)dynAtomicLoadPtr(&defaultPool);
+    if(!pool)
+    {
+        const char *threadCountEnv = getenv("DYN_THREAD_COUNT");
+        dynThreadPool *newPool = dtPoolCreate(threadCountEnv ? atoi(threadCountEnv) : 0);
+        if(dynAtomicCASPtr(&defaultPool, NULL, newPool))
+        {
+            pool = newPool;
+        }
+        else
+        {
+            dtPoolDestroy(newPool); // somebody beat us to it
+            pool = (dynThreadPool *)dynAtomicLoadPtr(&defaultPool);
+        }
+    }
+    return pool;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Parallel array helpers
+
+void daParallelFor(void *daptr, void * /*dynParallelForFunc*/ func, void *userData, dynSize grainSize)
+{
+    dtParallelForJob job;
+    dynThreadPool *pool;
+    long long chunkCount;
+    int i;
+
+    job.size = daSize(daptr);
+    if(job.size == 0)
+        return;
+    if(grainSize < 1)
+        grainSize = 1;
+    while(((job.size + grainSize - 1) / grainSize) > MAX_CHUNKS)
+        grainSize *= 2;
+    chunkCount = (job.size + grainSize - 1) / grainSize;
+
+    pool = dtDefaultPool();
+    job.daptr = daptr;
+    job.func = (dynParallelForFunc)func;
+    job.userData = userData;
+    job.grainSize = grainSize;
+    job.workerCount = dtPoolThreadCount(pool);
+    if(job.workerCount > chunkCount)
+        job.workerCount = (int)chunkCount;
+    if(job.workerCount <= 1)
+    {
+        job.func(daptr, 0, job.size, userData);
+        return;
+    }
+
+    // Every worker starts out owning an even share of the chunks; whoever runs dry steals
+    job.ranges = (dynAtomic64 *)calloc(job.workerCount, sizeof(dynAtomic64));
+    for(i = 0; i < job.workerCount; ++i)
+    {
+        long long begin = (chunkCount * i) / job.workerCount;
+        long long end = (chunkCount * (i + 1)) / job.workerCount;
+        dynAtomicStore64(&job.ranges[i], packRange(begin, end));
+    }
+    dtPoolRun(pool, dtParallelForWorker, &job);
+    free((void *)job.ranges);
+}
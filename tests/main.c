@@ -299,6 +299,8 @@ void test_daSize()
     daSize(&objects); // daSize() should never lazily create a dynArray
     if(objects)
         testFail("daSize is lazily creating dynArrays");
+    if((daSize(NULL) != 0) || (daCapacity(NULL) != 0) || (dsLength(NULL) != 0) || (dsCapacity(NULL) != 0))
+        testFail("size queries on a NULL handle should return 0");
     fillObjects(&objects);
     printf("size: " dynSizeFormat "\n", daSize(&objects));
     daDestroy(&objects, (dynDestroyFunc)destroyObject);
@@ -361,6 +363,1098 @@ void test_daSquash()
     daDestroy(&objects, (dynDestroyFunc)destroyObject);
 }
 
+static int isOddObject(Object **obj, void *userData)
+{
+    (void)userData;
+    return ((*obj)->name[0] - 'A') & 1;
+}
+
+static int isMultipleOf(dynU32 *v, dynU32 *divisor)
+{
+    return (*v % *divisor) == 0;
+}
+
+void test_daPrune()
+{
+    dynU32 *ints = NULL;
+    dynU16 *shorts = NULL;
+    Object **objects = NULL;
+    dynU32 divisor = 3;
+    dynSize removed;
+    int i;
+
+    daCreate(&ints, sizeof(dynU32));
+    daCreate(&shorts, sizeof(dynU16));
+    for(i = 0; i < 1000; ++i)
+    {
+        daPushU32(&ints, (i % 7) ? i : 0);
+        daPushU16(&shorts, (dynU16)((i % 40) < 30 ? i + 1 : 0)); // long non-zero runs
+    }
+    daSquash(&ints);
+    daSquash(&shorts);
+    if((daSize(&ints) != 857) || (daSize(&shorts) != 750))
+        testFail("daSquash kept " dynSizeFormat "/" dynSizeFormat " elements", daSize(&ints), daSize(&shorts));
+    for(i = 1; i < daSize(&ints); ++i)
+    {
+        if((ints[i] == 0) || (ints[i - 1] >= ints[i]))
+        {
+            testFail("daSquash mangled element %d", i);
+            break;
+        }
+    }
+
+    removed = daRemoveIf(&ints, isMultipleOf, &divisor, NULL);
+    for(i = 0; i < daSize(&ints); ++i)
+    {
+        if((ints[i] % 3) == 0)
+            testFail("daRemoveIf kept %u", ints[i]);
+    }
+    if((removed + daSize(&ints)) != 857)
+        testFail("daRemoveIf lost count of elements");
+
+    daEraseFast(&ints, 0);
+    if(ints[0] != 998)
+        testFail("daEraseFast didn't move the last element down");
+
+    fillObjects(&objects);
+    removed = daRemoveIf(&objects, isOddObject, NULL, destroyObject);
+    printObjects(&objects);
+    if((removed != 2) || (daSize(&objects) != 3))
+        testFail("daRemoveIf on objects removed " dynSizeFormat, removed);
+    daDestroy(&objects, (dynDestroyFunc)destroyObject);
+
+    daDestroy(&shorts, NULL);
+    daDestroy(&ints, NULL);
+}
+
+typedef struct SmallList
+{
+    dynU32 *values;
+    char storage[dynArrayStorageSize(sizeof(dynU32), 8)];
+} SmallList;
+
+void test_daStorage()
+{
+    char storage[dynArrayStorageSize(sizeof(dynU32), 4)];
+    char tiny[8];
+    SmallList list;
+    dynU32 *ints = NULL;
+    dynU32 *fallback = NULL;
+    int i;
+
+    daCreateWithStorage(&ints, sizeof(dynU32), storage, sizeof(storage));
+    if((daCapacity(&ints) < 4) || ((char *)ints < storage) || ((char *)ints >= (storage + sizeof(storage))))
+        testFail("daCreateWithStorage didn't use the caller's storage");
+    for(i = 0; i < 4; ++i)
+        daPushU32(&ints, i);
+    if(((char *)ints < storage) || ((char *)ints >= (storage + sizeof(storage))))
+        testFail("daCreateWithStorage spilled early");
+    for(i = 4; i < 100; ++i)
+        daPushU32(&ints, i); // spills to the heap
+    if(((char *)ints >= storage) && ((char *)ints < (storage + sizeof(storage))))
+        testFail("daCreateWithStorage never spilled");
+    for(i = 0; i < 100; ++i)
+    {
+        if(ints[i] != (dynU32)i)
+        {
+            testFail("spilled array lost element %d", i);
+            break;
+        }
+    }
+    daDestroy(&ints, NULL);
+
+    list.values = NULL;
+    daCreateWithStorage(&list.values, sizeof(dynU32), list.storage, sizeof(list.storage));
+    for(i = 0; i < 8; ++i)
+        daPushU32(&list.values, i * 2);
+    daSetCapacity(&list.values, 2, NULL); // shrinking in place, never freeing
+    if((daSize(&list.values) != 2) || (list.values[1] != 2))
+        testFail("shrinking a borrowed array went wrong");
+    daDestroy(&list.values, NULL);
+
+    daCreateWithStorage(&fallback, sizeof(dynU32), tiny, sizeof(tiny));
+    daPushU32(&fallback, 7);
+    if((fallback[0] != 7) || (((char *)fallback >= tiny) && ((char *)fallback < (tiny + sizeof(tiny)))))
+        testFail("undersized storage should fall back to the heap");
+    daDestroy(&fallback, NULL);
+}
+
+#define CLONE_COUNT 1000
+#define CLONE_THREADS 4
+
+static void cloneWorker(int threadIndex, void *userData)
+{
+    dynU32 **snapshot = (dynU32 **)userData;
+    dynU32 *mine = NULL;
+    int i;
+    daClone(&mine, snapshot); // concurrent clones only touch the reference count
+    daPushU32(&mine, (dynU32)threadIndex);
+    daErase(&mine, 0);
+    for(i = 0; i < (CLONE_COUNT - 1); ++i)
+    {
+        if(mine[i] != (dynU32)(i + 1))
+            break;
+    }
+    if((i != (CLONE_COUNT - 1)) || (mine[CLONE_COUNT - 1] != (dynU32)threadIndex))
+        testFail("thread %d's copy of the snapshot is wrong", threadIndex);
+    daDestroy(&mine, NULL);
+}
+
+void test_daClone()
+{
+    dynU32 *original = NULL;
+    dynU32 *snapshot = NULL;
+    dynU32 *other = NULL;
+    char **names = NULL;
+    char **namesClone = NULL;
+    char *name = dsDup("shared");
+    int i;
+
+    daCreate(&original, sizeof(dynU32));
+    for(i = 0; i < CLONE_COUNT; ++i)
+        daPushU32(&original, (dynU32)i);
+    daClone(&snapshot, &original);
+    daClone(&other, &snapshot);
+    if((snapshot != original) || (other != original))
+        testFail("daClone should share storage");
+
+    dtRun(CLONE_THREADS, cloneWorker, &snapshot);
+
+    daPushU32(&original, 12345); // copy-on-write: only original changes
+    if((original == snapshot) || (daSize(&snapshot) != CLONE_COUNT) || (daSize(&original) != (CLONE_COUNT + 1)))
+        testFail("modifying a clone should copy it first");
+    daDestroy(&snapshot, NULL);
+    original[0] = 99; // original has its own storage now, so writing directly is fine
+    if(other[0] != 0)
+        testFail("other should still see the original values");
+    daPushU32(&other, 7); // last handle left: modified in place
+    if(other[CLONE_COUNT] != 7)
+        testFail("pushing onto the last handle went wrong");
+
+    daPush(&names, name);
+    daClone(&namesClone, &names);
+    daDestroyStrings(&names);     // namesClone still holds the block, so nothing is freed yet
+    printf("clone still has: %s\n", namesClone[0]);
+    daClearStrings(&namesClone);  // last handle: frees the string
+    daDestroy(&namesClone, NULL);
+
+    daDestroy(&original, NULL);
+    daDestroy(&other, NULL);
+}
+
+void test_daGrowth()
+{
+    dynU32 *half = NULL;
+    dynU32 *chunked = NULL;
+    dynU8 *huge = NULL;
+    dynU32 *shrinking = NULL;
+    dynU32 *copy = NULL;
+    dynU32 value;
+    dynSize maxHalfCapacity = 0;
+    int i;
+
+    daCreate(&half, sizeof(dynU32));
+    daSetGrowth(&half, DA_GROW_HALF, 0);
+    daCreate(&chunked, sizeof(dynU32));
+    daSetGrowth(&chunked, DA_GROW_CHUNK, 100);
+    for(i = 0; i < 250; ++i)
+    {
+        daPushU32(&half, i);
+        daPushU32(&chunked, i);
+        if((daCapacity(&half) - daSize(&half)) > maxHalfCapacity)
+            maxHalfCapacity = daCapacity(&half) - daSize(&half);
+    }
+    printf("1.5x: capacity " dynSizeFormat ", chunks of 100: capacity " dynSizeFormat "\n", daCapacity(&half), daCapacity(&chunked));
+    if(maxHalfCapacity > 125)
+        testFail("DA_GROW_HALF left " dynSizeFormat " elements of slack", maxHalfCapacity);
+    if(daCapacity(&chunked) != 302)
+        testFail("DA_GROW_CHUNK capacity is " dynSizeFormat, daCapacity(&chunked));
+    daClone(&copy, &chunked);
+    daPushU32(&copy, 1); // the copy keeps the policy
+    daPushN(&copy, NULL, 350 - daSize(&copy));
+    if(daCapacity(&copy) != 402)
+        testFail("a cloned array lost its growth policy");
+
+    daCreate(&huge, sizeof(dynU8));
+    daSetGrowth(&huge, DA_GROW_PAGES, 0);
+    daPushN(&huge, NULL, 5 * 1024 * 1024);
+    if(((daCapacity(&huge) + dynArrayHeaderSize) % (2 * 1024 * 1024)) != 0)
+        testFail("DA_GROW_PAGES should fill whole 2MB pages");
+    daShrinkToFit(&huge);
+    if(daCapacity(&huge) != (5 * 1024 * 1024))
+        testFail("daShrinkToFit left capacity at " dynSizeFormat, daCapacity(&huge));
+
+    daCreate(&shrinking, sizeof(dynU32));
+    daPushN(&shrinking, NULL, 1000);
+    daSetAutoShrink(&shrinking, 1);
+    while(daSize(&shrinking) > 200)
+        daPop(&shrinking, &value);
+    if(daCapacity(&shrinking) != 512)
+        testFail("auto-shrink left capacity at " dynSizeFormat, daCapacity(&shrinking));
+    daClear(&shrinking, NULL);
+    if(daCapacity(&shrinking) != 2)
+        testFail("auto-shrink should shrink cleared arrays");
+
+    daDestroy(&half, NULL);
+    daDestroy(&chunked, NULL);
+    daDestroy(&copy, NULL);
+    daDestroy(&huge, NULL);
+    daDestroy(&shrinking, NULL);
+}
+
+#define FILE_COUNT 5000
+#define FILE_PATH "dynTestArray.bin"
+
+void test_daFile()
+{
+    dynU32 *saved = NULL;
+    dynU32 *mapped = NULL;
+    dynU32 *writable = NULL;
+    void *front;
+    int i;
+
+    daCreateDeque(&saved, sizeof(dynU32));
+    for(i = 0; i < FILE_COUNT; ++i)
+        daPushU32(&saved, (dynU32)(i * 3));
+    daUnshiftU32(&saved, 7); // wrapped deques are saved in order
+    front = daAt(&saved, 0);
+    if(!daSaveFile(&saved, FILE_PATH))
+        testFail("daSaveFile failed");
+    if((daAt(&saved, 0) != front) || (*(dynU32 *)daAt(&saved, 0) != 7))
+        testFail("daSaveFile rearranged the array it saved");
+
+    if(!daMapFile(&mapped, FILE_PATH, 0))
+        testFail("daMapFile failed");
+    if((daSize(&mapped) != (FILE_COUNT + 1)) || (mapped[0] != 7) || (mapped[FILE_COUNT] != ((FILE_COUNT - 1) * 3)))
+        testFail("mapped array doesn't match what was saved");
+    printf("mapped " dynSizeFormat " elements, sum " dynSizeFormat "\n", daSize(&mapped), (dynSize)(daSumU32(&mapped) & 0xffff));
+    daPushU32(&mapped, 1); // read-only: moves to the heap first
+    if((daSize(&mapped) != (FILE_COUNT + 2)) || (mapped[FILE_COUNT + 1] != 1) || (mapped[1] != 0))
+        testFail("pushing onto a read-only mapping went wrong");
+    daDestroy(&mapped, NULL);
+
+    if(!daMapFile(&writable, FILE_PATH, DA_MAP_WRITABLE))
+        testFail("daMapFile (writable) failed");
+    writable[0] = 99; // private page; the file never sees this
+    daSortU32(&writable); // sorts in place, in the private pages
+    daDestroy(&writable, NULL);
+    if(!daMapFile(&mapped, FILE_PATH, 0) || (mapped[0] != 7))
+        testFail("a writable mapping leaked changes into the file");
+    daDestroy(&mapped, NULL);
+
+    if(daMapFile(&mapped, "dynTestMissing.bin", 0) || mapped)
+        testFail("mapping a missing file should fail");
+    remove(FILE_PATH);
+    daDestroy(&saved, NULL);
+}
+
+static int batchCalls = 0;
+static int batchFreed = 0;
+
+static void destroyObjectBatch(void *elements, dynSize count)
+{
+    Object **objs = (Object **)elements;
+    dynSize i;
+    ++batchCalls;
+    for(i = 0; i < count; ++i)
+    {
+        free(objs[i]);
+        ++batchFreed;
+    }
+}
+
+static void sumBatch(void *elements, dynSize count)
+{
+    dynU32 *values = (dynU32 *)elements;
+    dynSize i;
+    ++batchCalls;
+    for(i = 0; i < count; ++i)
+        batchFreed += (int)values[i];
+}
+
+void test_daBatch()
+{
+    Object **objects = NULL;
+    dynU32 *ints = NULL;
+    dynU32 v;
+    int i;
+
+    fillObjects(&objects);
+    batchCalls = batchFreed = 0;
+    daClearBatch(&objects, destroyObjectBatch);
+    if((batchCalls != 1) || (batchFreed != 5) || (daSize(&objects) != 0))
+        testFail("daClearBatch: %d calls, %d freed", batchCalls, batchFreed);
+    fillObjects(&objects);
+    batchCalls = batchFreed = 0;
+    daDestroyBatch(&objects, destroyObjectBatch);
+    if((batchCalls != 1) || (batchFreed != 5) || objects)
+        testFail("daDestroyBatch: %d calls, %d freed", batchCalls, batchFreed);
+
+    // a wrapped deque is handed over as two runs
+    daCreateDeque(&ints, sizeof(dynU32));
+    for(i = 0; i < 16; ++i)
+        daPushU32(&ints, 1);
+    for(i = 0; i < 8; ++i)
+        daShift(&ints, &v);
+    for(i = 0; i < 4; ++i)
+        daPushU32(&ints, 1);
+    batchCalls = batchFreed = 0;
+    daDestroyBatch(&ints, sumBatch);
+    if((batchCalls != 2) || (batchFreed != 12))
+        testFail("daDestroyBatch deque: %d calls, sum %d", batchCalls, batchFreed);
+
+    batchCalls = 0;
+    daDestroyBatch(&ints, sumBatch); // no-op on a NULL array
+    daCreate(&ints, sizeof(dynU32));
+    daDestroyBatch(&ints, sumBatch); // never called for an empty one
+    if(batchCalls != 0)
+        testFail("daDestroyBatch called destroyFunc on nothing");
+}
+
+void test_daDeque()
+{
+    dynU32 *ints = NULL;
+    dynU32 v;
+    Object **objects = NULL;
+    Object *obj;
+    int i;
+
+    daCreateDeque(&ints, sizeof(dynU32));
+    for(i = 0; i < 1000; ++i)
+    {
+        daPushU32(&ints, i);
+        if(i % 3 == 0)
+            daShift(&ints, &v);
+    }
+    for(i = 0; i < 10; ++i)
+    {
+        daUnshiftU32(&ints, 10000 + i);
+    }
+    printf("size: " dynSizeFormat ", capacity: " dynSizeFormat "\n", daSize(&ints), daCapacity(&ints));
+    for(i = 0; i < 10; ++i)
+    {
+        if(*(dynU32 *)daAt(&ints, i) != (dynU32)(10009 - i))
+            testFail("daDeque unshifted element %d is wrong", i);
+    }
+    for(i = 10; i < daSize(&ints); ++i)
+    {
+        if(*(dynU32 *)daAt(&ints, i) != (dynU32)(i + 324))
+        {
+            testFail("daDeque element %d is %u", i, *(dynU32 *)daAt(&ints, i));
+            break;
+        }
+    }
+    daPop(&ints, &v);
+    if(v != 999)
+        testFail("daDeque popped %u instead of 999", v);
+    daInsertU32(&ints, 1, 42);
+    daErase(&ints, 0);
+    if((ints[0] != 42) || (ints[1] != 10008))
+        testFail("daDeque insert/erase did not linearize");
+    daDestroy(&ints, NULL);
+
+    daCreateDeque(&objects, 0);
+    fillObjects(&objects);
+    daShift(&objects, &obj);
+    destroyObject(obj);
+    obj = createObject("F");
+    daPush(&objects, obj);
+    obj = createObject("G");
+    daPush(&objects, obj);
+    daLinearize(&objects);
+    printObjects(&objects);
+    daDestroy(&objects, (dynDestroyFunc)destroyObject);
+}
+
+static int checkRange(dynU32 **ints, const dynU32 *expected, int count)
+{
+    int i;
+    if(daSize(ints) != count)
+        return 0;
+    for(i = 0; i < count; ++i)
+    {
+        if(*(dynU32 *)daAt(ints, i) != expected[i])
+            return 0;
+    }
+    return 1;
+}
+
+void test_daRange()
+{
+    static const dynU32 batch[] = { 1, 2, 3, 4, 5 };
+    static const dynU32 afterInsert[] = { 1, 2, 7, 8, 3, 4, 5, 1, 2, 3, 4, 5 };
+    static const dynU32 afterErase[] = { 1, 2, 4, 5, 1, 2, 3, 4, 5 };
+    static const dynU32 slice[] = { 5, 1, 2 };
+    dynU32 *ints = NULL;
+    dynU32 *other = NULL;
+    dynU32 *deque = NULL;
+    void *front;
+    dynU32 v;
+
+    daCreate(&ints, sizeof(dynU32));
+    daPushN(&ints, batch, 5);
+    daPushN(&ints, batch, 5);
+    daInsertRange(&ints, 2, batch + 1, 2);
+    ints[2] = 7;
+    ints[3] = 8;
+    if(!checkRange(&ints, afterInsert, 12))
+        testFail("daPushN/daInsertRange produced the wrong elements");
+    daEraseRange(&ints, 2, 3);
+    if(!checkRange(&ints, afterErase, 9))
+        testFail("daEraseRange produced the wrong elements");
+    daEraseRange(&ints, 7, 100);
+    if(daSize(&ints) != 7)
+        testFail("daEraseRange did not clamp to the end of the array");
+
+    daSlice(&other, &ints, 3, 6);
+    if(!checkRange(&other, slice, 3))
+        testFail("daSlice produced the wrong elements");
+    daAppendArray(&other, &other);
+    daAppendArray(&other, &ints);
+    printf("appended size: " dynSizeFormat "\n", daSize(&other));
+    if((daSize(&other) != 13) || (other[3] != 5) || (other[12] != 3))
+        testFail("daAppendArray produced the wrong elements");
+
+    // Wrapped deques copy in two pieces
+    daCreateDeque(&deque, sizeof(dynU32));
+    daPushN(&deque, batch, 4);
+    daShift(&deque, &v);
+    daShift(&deque, &v);
+    daShift(&deque, &v);
+    daPushN(&deque, batch, 3);
+    daSlice(&other, &deque, 0, -1);
+    if((daSize(&other) != 4) || (other[0] != 4) || (other[1] != 1) || (other[3] != 3))
+        testFail("daPushN/daSlice mishandled a wrapped deque");
+    front = daAt(&deque, 0);
+    daAppendArray(&other, &deque);
+    if((daSize(&other) != 8) || (other[4] != 4) || (other[5] != 1) || (other[7] != 3))
+        testFail("daAppendArray mishandled a wrapped deque");
+    if(daAt(&deque, 0) != front)
+        testFail("daAppendArray rearranged its source");
+
+    daDestroy(&deque, NULL);
+    daDestroy(&other, NULL);
+    daDestroy(&ints, NULL);
+}
+
+void test_daUninit()
+{
+    dynU32 *ints = NULL;
+    dynU32 *p;
+    int i;
+
+    daCreate(&ints, sizeof(dynU32));
+    daReserveUninit(&ints, 1000);
+    for(i = 0; i < 1000; ++i)
+    {
+        ints[i] = i;
+    }
+    p = (dynU32 *)daPushUninit(&ints, 24);
+    for(i = 0; i < 24; ++i)
+    {
+        p[i] = 1000 + i;
+    }
+    printf("size: " dynSizeFormat ", capacity: " dynSizeFormat "\n", daSize(&ints), daCapacity(&ints));
+    for(i = 0; i < daSize(&ints); ++i)
+    {
+        if(ints[i] != (dynU32)i)
+        {
+            testFail("daReserveUninit/daPushUninit element %d is wrong", i);
+            break;
+        }
+    }
+    daSetSize(&ints, 2000, NULL); // zero-filling growth still zero-fills
+    if((ints[1023] != 1023) || (ints[1024] != 0) || (ints[1999] != 0))
+        testFail("daSetSize did not keep old elements and zero new ones");
+    daDestroy(&ints, NULL);
+}
+
+void test_daInline()
+{
+    dynU32 *ints = NULL;
+    char *str = NULL;
+    int i;
+
+    daCreate(&ints, sizeof(dynU32));
+    daSetCapacity(&ints, 100, NULL);
+    for(i = 0; i < 150; ++i) // the first 100 never leave the inline path
+    {
+        if(daPushU32(&ints, i) != i)
+            testFail("daPushU32 returned the wrong index for %d", i);
+    }
+    if((daSize(&ints) != 150) || (ints[99] != 99) || (ints[149] != 149))
+        testFail("inline daPushU32 produced the wrong array");
+    daDestroy(&ints, NULL);
+
+    if((daSize(&ints) != 0) || (dsLength(&str) != 0) || (dsCapacity(&str) != 0))
+        testFail("inline accessors mishandle NULL arrays/strings");
+    dsCopy(&str, "inline");
+    if(dsLength(&str) != 6)
+        testFail("inline dsLength is wrong");
+    dsDestroy(&str);
+}
+
+static unsigned int testRandomState = 12345;
+static unsigned int testRandom()
+{
+    testRandomState = (testRandomState * 1103515245) + 12345;
+    return testRandomState >> 8;
+}
+
+static int compareU32(const dynU32 *a, const dynU32 *b)
+{
+    return (*a > *b) - (*a < *b);
+}
+
+typedef struct SortRecord
+{
+    int key;
+    int order;
+} SortRecord;
+
+static int compareSortRecords(const SortRecord *a, const SortRecord *b)
+{
+    return a->key - b->key;
+}
+
+#define SORT_COUNT 10000
+void test_daSort()
+{
+    dynU32 *ints = NULL;
+    dynU32 *sorted = NULL;
+    dynF32 *floats = NULL;
+    dynU16 *shorts = NULL;
+    dynU8 *bytes = NULL;
+    SortRecord *records = NULL;
+    dynU32 key;
+    int i;
+
+    daCreate(&ints, sizeof(dynU32));
+    daCreate(&floats, sizeof(dynF32));
+    daCreate(&shorts, sizeof(dynU16));
+    daCreate(&bytes, sizeof(dynU8));
+    for(i = 0; i < SORT_COUNT; ++i)
+    {
+        daPushU32(&ints, testRandom());
+        daPushF32(&floats, (dynF32)((int)(testRandom() % 2000) - 1000) / 7.0f);
+        daPushU16(&shorts, (dynU16)testRandom());
+        daPushU8(&bytes, (dynU8)testRandom());
+    }
+
+    daSlice(&sorted, &ints, 0, -1);
+    daSort(&sorted, compareU32);
+    daSortU32(&ints);
+    for(i = 0; i < SORT_COUNT; ++i)
+    {
+        if(ints[i] != sorted[i])
+        {
+            testFail("daSortU32 and daSort disagree at %d", i);
+            break;
+        }
+    }
+    for(i = 1; i < SORT_COUNT; ++i)
+    {
+        if(sorted[i - 1] > sorted[i])
+        {
+            testFail("daSort left element %d out of order", i);
+            break;
+        }
+    }
+
+    daSortF32(&floats);
+    daSortU16(&shorts);
+    daSortU8(&bytes);
+    for(i = 1; i < SORT_COUNT; ++i)
+    {
+        if((floats[i - 1] > floats[i]) || (shorts[i - 1] > shorts[i]) || (bytes[i - 1] > bytes[i]))
+        {
+            testFail("radix sort left element %d out of order", i);
+            break;
+        }
+    }
+    printf("floats: %2.2f .. %2.2f\n", floats[0], floats[SORT_COUNT - 1]);
+
+    key = ints[SORT_COUNT / 2];
+    i = daBinarySearch(&ints, &key, compareU32);
+    if((i < 0) || (ints[i] != key))
+        testFail("daBinarySearch could not find an existing key");
+    key = ints[0] - 1;
+    if((ints[0] > 0) && (daBinarySearch(&ints, &key, compareU32) != -1))
+        testFail("daBinarySearch found a missing key");
+    key = ints[100];
+    i = daLowerBound(&ints, &key, compareU32);
+    if((ints[i] != key) || ((i > 0) && (ints[i - 1] >= key)))
+        testFail("daLowerBound is wrong");
+    i = daUpperBound(&ints, &key, compareU32);
+    if((ints[i - 1] != key) || ((i < SORT_COUNT) && (ints[i] <= key)))
+        testFail("daUpperBound is wrong");
+
+    // Searching a wrapped deque (and a snapshot of it) leaves its storage alone
+    daDestroy(&sorted, NULL);
+    daCreateDeque(&sorted, sizeof(dynU32));
+    for(i = 0; i < 41; ++i)
+        daPushU32(&sorted, 0);
+    for(i = 0; i < 40; ++i)
+        daShift(&sorted, &key); // keeps one 0, so the head stays put
+    for(i = 1; i < 50; ++i)
+        daPushU32(&sorted, i * 2);
+    if((char *)daAt(&sorted, 49) > (char *)daAt(&sorted, 0))
+        testFail("search test deque didn't wrap");
+    {
+        dynU32 *snapshot = NULL;
+        void *first = daAt(&sorted, 0);
+        key = 60;
+        if((daBinarySearch(&sorted, &key, compareU32) != 30) || (daLowerBound(&sorted, &key, compareU32) != 30))
+            testFail("searching a wrapped deque is wrong");
+        key = 61;
+        if((daBinarySearch(&sorted, &key, compareU32) != -1) || (daUpperBound(&sorted, &key, compareU32) != 31))
+            testFail("searching a wrapped deque for a missing key is wrong");
+        if(daAt(&sorted, 0) != first)
+            testFail("searching rearranged a wrapped deque");
+        daClone(&snapshot, &sorted);
+        if(daBinarySearch(&snapshot, &key, compareU32) != -1)
+            testFail("searching a snapshot is wrong");
+        daDestroy(&snapshot, NULL);
+    }
+    if((daBinarySearch(NULL, &key, compareU32) != -1) || (daLowerBound(NULL, &key, compareU32) != 0))
+        testFail("searching a NULL handle is wrong");
+
+    daCreate(&records, sizeof(SortRecord));
+    for(i = 0; i < SORT_COUNT; ++i)
+    {
+        SortRecord record;
+        record.key = testRandom() % 50;
+        record.order = i;
+        daPush(&records, record);
+    }
+    daStableSort(&records, compareSortRecords);
+    for(i = 1; i < SORT_COUNT; ++i)
+    {
+        if((records[i - 1].key > records[i].key) || ((records[i - 1].key == records[i].key) && (records[i - 1].order > records[i].order)))
+        {
+            testFail("daStableSort is not stable at %d", i);
+            break;
+        }
+    }
+
+    daDestroy(&records, NULL);
+    daDestroy(&bytes, NULL);
+    daDestroy(&shorts, NULL);
+    daDestroy(&floats, NULL);
+    daDestroy(&sorted, NULL);
+    daDestroy(&ints, NULL);
+}
+
+typedef struct BigRecord
+{
+    dynU32 key;
+    char payload[124]; // bigger than the heap's on-stack scratch element
+} BigRecord;
+
+static int compareBigRecords(const BigRecord *a, const BigRecord *b)
+{
+    return (a->key > b->key) - (a->key < b->key);
+}
+
+#define HEAP_COUNT 5000
+void test_daHeap()
+{
+    dynU32 *heap = NULL;
+    dynU32 *values = NULL;
+    dynU32 *top = NULL;
+    dynF32 *floats = NULL;
+    SortRecord *records = NULL;
+    SortRecord record;
+    dynU32 v, prev = 0;
+    dynF32 f;
+    int i;
+
+    daCreate(&heap, sizeof(dynU32));
+    daCreate(&values, sizeof(dynU32));
+    for(i = 0; i < HEAP_COUNT; ++i)
+    {
+        v = testRandom() % 100000;
+        daHeapPushU32(&heap, v);
+        daPushU32(&values, v);
+    }
+    for(i = 0; daHeapPopU32(&heap, &v); ++i)
+    {
+        if(v < prev)
+        {
+            testFail("daHeapPopU32 came out of order at %d", i);
+            break;
+        }
+        prev = v;
+    }
+    if(i != HEAP_COUNT)
+        testFail("daHeapPopU32 popped %d elements", i);
+
+    daTopK(&top, &values, 10, compareU32);
+    daSort(&values, compareU32);
+    for(i = 0; i < 10; ++i)
+    {
+        if(top[i] != values[HEAP_COUNT - 1 - i])
+            testFail("daTopK element %d is wrong", i);
+    }
+
+    // A wrapped deque source is read where it lies
+    daDestroy(&values, NULL);
+    daCreateDeque(&values, sizeof(dynU32));
+    for(i = 0; i < 41; ++i)
+        daPushU32(&values, 0);
+    for(i = 0; i < 40; ++i)
+        daShift(&values, &v);
+    for(i = 1; i < 50; ++i)
+        daPushU32(&values, (dynU32)((i * 37) % 50));
+    {
+        void *first = daAt(&values, 0);
+        daTopK(&top, &values, 3, compareU32);
+        if((daSize(&top) != 3) || (top[0] != 49) || (top[1] != 48) || (top[2] != 47))
+            testFail("daTopK over a wrapped deque is wrong");
+        if(daAt(&values, 0) != first)
+            testFail("daTopK rearranged its source");
+    }
+
+    {
+        BigRecord *big = NULL;
+        BigRecord *bigTop = NULL;
+        BigRecord bigRecord;
+        daCreate(&big, sizeof(BigRecord));
+        memset(&bigRecord, 0, sizeof(bigRecord));
+        for(i = 0; i < 1000; ++i)
+        {
+            bigRecord.key = (dynU32)((i * 389) % 1000);
+            bigRecord.payload[0] = (char)bigRecord.key;
+            daPush(&big, bigRecord);
+        }
+        daTopK(&bigTop, &big, 4, compareBigRecords);
+        if((daSize(&bigTop) != 4) || (bigTop[0].key != 999) || (bigTop[3].key != 996) || (bigTop[3].payload[0] != (char)996))
+            testFail("daTopK over large records is wrong");
+        daTopK(&bigTop, &big, 5000, compareBigRecords); // k > size keeps everything, sorted
+        if((daSize(&bigTop) != 1000) || (bigTop[0].key != 999) || (bigTop[999].key != 0))
+            testFail("daTopK with k > size is wrong");
+        daDestroy(&bigTop, NULL);
+        daDestroy(&big, NULL);
+    }
+
+    daCreate(&floats, sizeof(dynF32));
+    for(i = 0; i < 100; ++i)
+        daHeapPushBoundedF32(&floats, (dynF32)i, 5); // keeps the 5 largest
+    if((daSize(&floats) != 5) || !daHeapPopF32(&floats, &f) || (f != 95.0f))
+        testFail("daHeapPushBoundedF32 kept the wrong values");
+
+    daCreate(&records, sizeof(SortRecord));
+    for(i = 0; i < 100; ++i)
+    {
+        record.key = 99 - i;
+        record.order = i;
+        daPush(&records, record);
+    }
+    daHeapify(&records, compareSortRecords);
+    for(i = 0; daHeapPop(&records, &record, compareSortRecords); ++i)
+    {
+        if(record.key != i)
+        {
+            testFail("daHeapify/daHeapPop gave key %d at %d", record.key, i);
+            break;
+        }
+    }
+
+    daDestroy(&records, NULL);
+    daDestroy(&floats, NULL);
+    daDestroy(&top, NULL);
+    daDestroy(&values, NULL);
+    daDestroy(&heap, NULL);
+}
+
+static void countPoolThread(int threadIndex, int *hits)
+{
+    hits[threadIndex]++;
+}
+
+static void squareRange(dynU32 **daptr, dynSize start, dynSize end, void *userData)
+{
+    dynSize i;
+    (void)userData;
+    for(i = start; i < end; ++i)
+        (*daptr)[i] = (*daptr)[i] * (*daptr)[i];
+}
+
+#define SIMD_COUNT 1003 // deliberately not a multiple of any vector width
+void test_daSimd()
+{
+    dynF32 *floats = NULL;
+    dynF32 *weights = NULL;
+    dynU32 *ints = NULL;
+    dynF32 floatSum = 0.0f, dot = 0.0f, floatMin = 0.0f, floatMax = 0.0f, lo, hi;
+    dynU64 intSum = 0;
+    dynU32 intMin = 0xffffffff, intMax = 0, running = 0, ilo, ihi;
+    int i;
+
+    daCreate(&floats, sizeof(dynF32));
+    daCreate(&weights, sizeof(dynF32));
+    daCreate(&ints, sizeof(dynU32));
+    for(i = 0; i < SIMD_COUNT; ++i)
+    {
+        // Small integral values keep the float math exact regardless of summation order
+        dynF32 f = (dynF32)((int)(testRandom() % 200) - 100);
+        dynF32 w = (dynF32)(testRandom() % 4);
+        dynU32 u = testRandom() * 4099;
+        daPushF32(&floats, f);
+        daPushF32(&weights, w);
+        daPushU32(&ints, u);
+        floatSum += f;
+        dot += f * w;
+        intSum += u;
+        if((i == 0) || (f < floatMin))
+            floatMin = f;
+        if((i == 0) || (f > floatMax))
+            floatMax = f;
+        if(u < intMin)
+            intMin = u;
+        if(u > intMax)
+            intMax = u;
+    }
+
+    if(daSumF32(&floats) != floatSum)
+        testFail("daSumF32: %f != %f", daSumF32(&floats), floatSum);
+    if(daDotF32(&floats, &weights) != dot)
+        testFail("daDotF32: %f != %f", daDotF32(&floats, &weights), dot);
+    if(daSumU32(&ints) != intSum)
+        testFail("daSumU32 is wrong");
+    if(!daMinMaxF32(&floats, &lo, &hi) || (lo != floatMin) || (hi != floatMax))
+        testFail("daMinMaxF32 is wrong");
+    if(!daMinMaxU32(&ints, &ilo, &ihi) || (ilo != intMin) || (ihi != intMax))
+        testFail("daMinMaxU32: %u..%u != %u..%u", ilo, ihi, intMin, intMax);
+
+    daScaleF32(&floats, 0.5f);
+    if(daSumF32(&floats) != (floatSum * 0.5f))
+        testFail("daScaleF32 is wrong");
+
+    daSetSize(&ints, 0, NULL);
+    for(i = 0; i < SIMD_COUNT; ++i)
+        daPushU32(&ints, i + 1);
+    daPrefixSumU32(&ints);
+    for(i = 0; i < SIMD_COUNT; ++i)
+    {
+        running += i + 1;
+        if(ints[i] != running)
+        {
+            testFail("daPrefixSumU32 is wrong at %d", i);
+            break;
+        }
+    }
+
+    daSetSize(&ints, 0, NULL);
+    if(daMinMaxU32(&ints, NULL, NULL) || (daSumU32(&ints) != 0))
+        testFail("kernels mishandle an empty array");
+    if((daSumF32(NULL) != 0.0f) || daMinMaxF32(NULL, &lo, &hi) || (daDotF32(&floats, NULL) != 0.0f))
+        testFail("kernels mishandle a NULL handle");
+    daDestroy(&ints, NULL);
+    daScaleF32(&ints, 2.0f);
+    daPrefixSumU32(&ints);
+    if(ints)
+        testFail("writing kernels created an array");
+
+    // Wrapped deques are read in two runs and left exactly as they were
+    daCreateDeque(&ints, sizeof(dynU32));
+    for(i = 0; i < 64; ++i)
+        daPushU32(&ints, 1000);
+    for(i = 0; i < 40; ++i)
+        daShift(&ints, &ilo);
+    for(i = 0; i < 30; ++i)
+        daPushU32(&ints, (dynU32)i);
+    {
+        void *first = daAt(&ints, 0);
+        if(!daMinMaxU32(&ints, &ilo, &ihi) || (ilo != 0) || (ihi != 1000) || (daSumU32(&ints) != ((24 * 1000) + 435)))
+            testFail("kernels mishandle a wrapped deque");
+        if(daAt(&ints, 0) != first)
+            testFail("read-only kernels rearranged a wrapped deque");
+    }
+    daDestroy(&ints, NULL);
+
+    daDestroy(&floats, NULL);
+    daCreateDeque(&floats, sizeof(dynF32));
+    daSetSize(&weights, 0, NULL);
+    for(i = 0; i < 32; ++i)
+        daPushF32(&floats, 0.0f);
+    for(i = 0; i < 20; ++i)
+        daShift(&floats, &lo);
+    for(i = 0; i < 20; ++i)
+        daPushF32(&floats, 1.0f);
+    for(i = 0; i < 30; ++i)
+        daPushF32(&weights, (dynF32)i);
+    // 12 zeros then 20 ones, wrapping after the 12th; only the first 30 line up with weights
+    if(daDotF32(&weights, &floats) != 369.0f)
+        testFail("daDotF32 across a wrapped deque: %f", daDotF32(&weights, &floats));
+
+    daDestroy(&weights, NULL);
+    daDestroy(&floats, NULL);
+}
+
+#define QUEUE_COUNT 200000
+
+typedef struct QueueTest
+{
+    dynQueue *dq;
+    int producers;           // threads [0, producers) push, the rest pop
+    unsigned long long sums[4];
+    int outOfOrder;
+} QueueTest;
+
+// Producers push 1..QUEUE_COUNT in small batches and then a 0; each consumer stops at its first 0
+static void queueTestThread(int threadIndex, QueueTest *qt)
+{
+    dynU32 batch[16];
+    dynSize i, n;
+    if(threadIndex < qt->producers)
+    {
+        dynU32 next = 1;
+        while(next <= QUEUE_COUNT)
+        {
+            dynSize count = 0;
+            while((count < 16) && ((next + count) <= QUEUE_COUNT))
+            {
+                batch[count] = next + (dynU32)count;
+                ++count;
+            }
+            for(i = 0; i < count; )
+            {
+                dynSize pushed = dqPushN(qt->dq, batch + i, count - i);
+                if(!pushed)
+                    dtYield();
+                i += pushed;
+            }
+            next += (dynU32)count;
+        }
+        batch[0] = 0;
+        while(!dqPush(qt->dq, batch))
+            dtYield();
+    }
+    else
+    {
+        dynU32 last = 0;
+        for(;;)
+        {
+            // With several producers a consumer pops singly, so it never swallows a second 0
+            n = dqPopN(qt->dq, batch, (qt->producers == 1) ? 16 : 1);
+            if(!n)
+                dtYield();
+            for(i = 0; i < n; ++i)
+            {
+                if(batch[i] == 0)
+                    return; // (a 0 is always the last thing its producer pushes)
+                if((qt->producers == 1) && (batch[i] != (last + 1)))
+                    qt->outOfOrder = 1;
+                last = batch[i];
+                qt->sums[threadIndex] += batch[i];
+            }
+        }
+    }
+}
+
+void test_dqQueue()
+{
+    QueueTest qt;
+    unsigned long long expected = ((unsigned long long)QUEUE_COUNT * (QUEUE_COUNT + 1)) / 2;
+    dynU32 v = 5, out = 0;
+    dynU32 in[100], got[100];
+    dynSize i, popped;
+
+    memset(&qt, 0, sizeof(qt));
+    qt.dq = dqCreate(sizeof(dynU32), 100, DQF_SPSC);
+    if((dqCapacity(qt.dq) != 128) || dqPop(qt.dq, &out) || !dqPush(qt.dq, &v) || (dqSize(qt.dq) != 1) || !dqPop(qt.dq, &out) || (out != 5))
+        testFail("basic SPSC push/pop failed");
+    qt.producers = 1;
+    dtRun(2, queueTestThread, &qt);
+    if(qt.outOfOrder || (qt.sums[1] != expected))
+        testFail("SPSC queue lost or reordered elements");
+    dqDestroy(qt.dq);
+
+    memset(&qt, 0, sizeof(qt));
+    qt.dq = dqCreate(sizeof(dynU32), 64, DQF_MPMC);
+    for(i = 0; i < 100; ++i) // the second push wraps around the ring
+        in[i] = (dynU32)i;
+    if((dqPushN(qt.dq, in, 100) != 64) || (dqPopN(qt.dq, got, 40) != 40) || (dqPushN(qt.dq, in + 64, 36) != 36))
+        testFail("MPMC batch push/pop counts are wrong");
+    popped = dqPopN(qt.dq, got + 40, 100);
+    if(popped != 60)
+        testFail("MPMC batch pop returned " dynSizeFormat, popped);
+    for(i = 0; i < 100; ++i)
+    {
+        if(got[i] != (dynU32)i)
+        {
+            testFail("MPMC batches came out of order at " dynSizeFormat, i);
+            break;
+        }
+    }
+
+    qt.producers = 2;
+    dtRun(4, queueTestThread, &qt);
+    if((qt.sums[2] + qt.sums[3]) != (expected * 2))
+        testFail("MPMC queue lost elements");
+    if(dqSize(qt.dq) != 0)
+        testFail("MPMC queue should be drained");
+    dqDestroy(qt.dq);
+}
+
+#define PARALLEL_COUNT 100000
+void test_daParallel()
+{
+    dynThreadPool *pool;
+    dynU32 *ints = NULL;
+    dynU32 *sorted = NULL;
+    int hits[4] = { 0 };
+    int run;
+    int i;
+
+    // Make sure the default pool is genuinely threaded, even on a single core box
+#ifdef _WIN32
+    _putenv("DYN_THREAD_COUNT=4");
+#else
+    setenv("DYN_THREAD_COUNT", "4", 0);
+#endif
+
+    pool = dtPoolCreate(4);
+    for(run = 0; run < 3; ++run)
+        dtPoolRun(pool, countPoolThread, hits);
+    for(i = 0; i < 4; ++i)
+    {
+        if(hits[i] != 3)
+            testFail("dtPoolRun ran thread %d %d times", i, hits[i]);
+    }
+    dtPoolDestroy(pool);
+
+    daCreate(&ints, sizeof(dynU32));
+    for(i = 0; i < PARALLEL_COUNT; ++i)
+        daPushU32(&ints, i);
+    daParallelFor(&ints, squareRange, NULL, 1000);
+    for(i = 0; i < PARALLEL_COUNT; ++i)
+    {
+        if(ints[i] != (dynU32)i * (dynU32)i)
+        {
+            testFail("daParallelFor missed index %d", i);
+            break;
+        }
+    }
+
+    for(i = 0; i < PARALLEL_COUNT; ++i)
+        ints[i] = testRandom() % 5000; // plenty of duplicates
+    daSlice(&sorted, &ints, 0, -1);
+    daSort(&sorted, compareU32);
+    daParallelSort(&ints, compareU32);
+    for(i = 0; i < PARALLEL_COUNT; ++i)
+    {
+        if(ints[i] != sorted[i])
+        {
+            testFail("daParallelSort and daSort disagree at %d", i);
+            break;
+        }
+    }
+
+    daDestroy(&sorted, NULL);
+    daDestroy(&ints, NULL);
+}
 
 void test_da8()
 {
@@ -436,6 +1530,370 @@ void test_daStruct()
     daDestroy(&objs, NULL);
 }
 
+// ------------------------------------------------------------------------------------------------
+// dynChunkArray Tests
+
+void test_dcChunk()
+{
+    dynChunkArray *dc = dcCreate(sizeof(dynU32), 100); // rounds up to 128 per chunk
+    dynU32 *first;
+    dynU32 bulk[1000];
+    dynSize chunkIndex, count, total = 0;
+    int i;
+
+    for(i = 0; i < 1000; ++i)
+    {
+        dynU32 v = i;
+        dynU32 *p = (dynU32 *)dcPush(dc, &v);
+        if(i == 0)
+            first = p;
+    }
+    for(i = 0; i < 1000; ++i)
+        bulk[i] = 1000 + i;
+    if(dcPushN(dc, bulk, 1000) != 1000)
+        testFail("dcPushN returned the wrong first index");
+
+    if((dcSize(dc) != 2000) || (dcAt(dc, 0) != first) || (dcAt(dc, 2000) != NULL))
+        testFail("dcAt/dcSize are wrong, or element 0 moved");
+    for(i = 0; i < 2000; ++i)
+    {
+        if(*(dynU32 *)dcAt(dc, i) != (dynU32)i)
+        {
+            testFail("dcAt(%d) is wrong", i);
+            break;
+        }
+    }
+    for(chunkIndex = 0; chunkIndex < dcChunkCount(dc); ++chunkIndex)
+    {
+        dynU32 *values = (dynU32 *)dcChunk(dc, chunkIndex, &count);
+        if(values[0] != (dynU32)total)
+            testFail("chunk " dynSizeFormat " starts in the wrong place", chunkIndex);
+        total += count;
+    }
+    if((total != 2000) || (dcChunkCount(dc) != 16))
+        testFail("chunk walk covered " dynSizeFormat " elements", total);
+
+    dcPop(dc, NULL);
+    if(dcSize(dc) != 1999)
+        testFail("dcPop didn't shrink the array");
+    dcClear(dc, NULL);
+    dcPush(dc, NULL);
+    if((dcSize(dc) != 1) || (*(dynU32 *)dcAt(dc, 0) != 0))
+        testFail("dcPush(NULL) should zero-fill");
+    dcDestroy(dc, NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+// dynRecords Tests
+
+typedef struct Event
+{
+    char tag;
+    dynU32 id;
+    dynF32 value;
+} Event;
+
+void test_drRecords()
+{
+    dynRecordField fields[] = {
+        DYN_RECORD_FIELD(Event, tag),
+        DYN_RECORD_FIELD(Event, id),
+        DYN_RECORD_FIELD(Event, value)
+    };
+    dynRecords *dr = drCreate(fields, 3, sizeof(Event));
+    Event e;
+    dynU32 *ids;
+    dynF32 expectedSum = 0.0f;
+    int i;
+
+    drReserve(dr, 100);
+    for(i = 0; i < 100; ++i)
+    {
+        e.tag = (char)('a' + (i % 26));
+        e.id = i * 10;
+        e.value = (dynF32)i;
+        expectedSum += e.value;
+        if(drPush(dr, &e) != i)
+            testFail("drPush returned the wrong index");
+    }
+
+    ids = (dynU32 *)drColumn(dr, 1);
+    for(i = 0; i < 100; ++i)
+    {
+        if(ids[i] != (dynU32)(i * 10))
+        {
+            testFail("id column is wrong at %d", i);
+            break;
+        }
+    }
+    if(daSumF32(drColumnArray(dr, 2)) != expectedSum)
+        testFail("value column doesn't add up");
+
+    e.tag = 'z';
+    e.id = 12345;
+    e.value = -1.0f;
+    drSet(dr, 50, &e);
+    drErase(dr, 0);
+    memset(&e, 0, sizeof(e));
+    if(!drGet(dr, 49, &e) || (e.tag != 'z') || (e.id != 12345) || (e.value != -1.0f))
+        testFail("drSet/drErase/drGet round trip failed");
+    if((drSize(dr) != 99) || drGet(dr, 99, &e))
+        testFail("drSize is wrong after drErase");
+
+    drClear(dr);
+    drPush(dr, NULL);
+    if((drSize(dr) != 1) || (((dynU32 *)drColumn(dr, 1))[0] != 0))
+        testFail("drPush(NULL) should zero-fill");
+    drDestroy(dr);
+}
+
+// ------------------------------------------------------------------------------------------------
+// dynSlotMap Tests
+
+void test_dhSlotMap()
+{
+    dynSlotMap *sm = dhCreate(sizeof(dynU32));
+    dynHandle handles[100];
+    dynHandle reused;
+    dynU32 *values;
+    dynU32 v, sum = 0;
+    dynSize i;
+
+    for(i = 0; i < 100; ++i)
+    {
+        v = (dynU32)i;
+        handles[i] = dhInsert(sm, &v, NULL);
+    }
+    for(i = 0; i < 100; i += 2)
+    {
+        if(!dhErase(sm, handles[i], NULL))
+            testFail("dhErase refused a live handle");
+    }
+    if(dhErase(sm, handles[0], NULL) || dhGet(sm, handles[0]) || dhGet(sm, DYN_INVALID_HANDLE))
+        testFail("a stale handle still resolves");
+    for(i = 1; i < 100; i += 2)
+    {
+        dynU32 *p = (dynU32 *)dhGet(sm, handles[i]);
+        if(!p || (*p != (dynU32)i))
+        {
+            testFail("handle " dynSizeFormat " lost its element", i);
+            break;
+        }
+    }
+
+    // Slots get reused, but the old handles stay dead
+    reused = dhInsert(sm, NULL, NULL);
+    if((dhGet(sm, reused) == NULL) || (*(dynU32 *)dhGet(sm, reused) != 0) || (reused == handles[98]) || dhGet(sm, handles[98]))
+        testFail("reusing a slot confused old and new handles");
+    dhErase(sm, reused, NULL);
+
+    values = (dynU32 *)dhValues(sm);
+    for(i = 0; i < dhSize(sm); ++i)
+    {
+        sum += values[i];
+        if(*(dynU32 *)dhGet(sm, dhHandleAt(sm, i)) != values[i])
+            testFail("dhHandleAt doesn't match the dense values");
+    }
+    if((dhSize(sm) != 50) || (sum != 2500))
+        testFail("dense iteration saw " dynSizeFormat " elements summing to %u", dhSize(sm), sum);
+
+    dhClear(sm, NULL);
+    if((dhSize(sm) != 0) || dhGet(sm, handles[1]))
+        testFail("dhClear should invalidate every handle");
+    dhDestroy(sm, NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+// dynPool Tests
+
+void test_dpPool()
+{
+    dynPool *pool = dpCreate(sizeof(Object), 16);
+    Object **objects = NULL;
+    Object *bulk[40];
+    Object *obj, *again;
+    int i;
+
+    for(i = 0; i < 5; ++i)
+    {
+        obj = (Object *)dpCalloc(pool);
+        obj->name = names[i];
+        daPush(&objects, obj);
+    }
+    printObjects(&objects);
+    if(dpLiveCount(pool) != 5)
+        testFail("dpLiveCount is wrong after dpCalloc");
+
+    obj = objects[2];
+    daErase(&objects, 2);
+    dpFree(pool, obj);
+    again = (Object *)dpAlloc(pool);
+    if(again != obj)
+        testFail("dpAlloc didn't reuse the freed object");
+    dpFree(pool, again);
+
+    dpAllocN(pool, (void **)bulk, 40); // spans a few blocks
+    for(i = 0; i < 40; ++i)
+        bulk[i]->name = "bulk";
+    if(dpLiveCount(pool) != 44)
+        testFail("dpAllocN left dpLiveCount at " dynSizeFormat, dpLiveCount(pool));
+    dpFreeN(pool, (void **)bulk, 40);
+    dpFreeN(pool, (void **)objects, daSize(&objects));
+    if(dpLiveCount(pool) != 0)
+        testFail("dpFreeN left dpLiveCount at " dynSizeFormat, dpLiveCount(pool));
+
+    dpClear(pool);
+    obj = (Object *)dpCalloc(pool);
+    if(obj->name != NULL)
+        testFail("dpCalloc didn't zero");
+    daDestroy(&objects, NULL); // no destroyFunc: the pool owns them
+    dpDestroy(pool);
+}
+
+// ------------------------------------------------------------------------------------------------
+// dynBitset Tests
+
+#define BITS_COUNT 1000
+
+void test_dbBits()
+{
+    dynBitset *a = dbCreate(BITS_COUNT);
+    dynBitset *b = dbCreate(BITS_COUNT - 200);
+    dynBitset *c = dbCreate(BITS_COUNT);
+    char inA[BITS_COUNT], inB[BITS_COUNT];
+    dynSize countA = 0, both = 0, expected, index;
+    int i;
+
+    memset(inA, 0, sizeof(inA));
+    memset(inB, 0, sizeof(inB));
+    for(i = 0; i < BITS_COUNT; ++i)
+    {
+        if((testRandom() % 3) == 0)
+        {
+            dbSet(a, i);
+            inA[i] = 1;
+            ++countA;
+        }
+        if((i < (BITS_COUNT - 200)) && (testRandom() % 2))
+        {
+            dbSet(b, i);
+            inB[i] = 1;
+            if(inA[i])
+                ++both;
+        }
+    }
+    dbSet(a, BITS_COUNT); // out of range, ignored
+    if(dbTest(a, BITS_COUNT) || dbTest(a, -1))
+        testFail("dbTest should be 0 out of range");
+    if(dbCount(a) != countA)
+        testFail("dbCount is " dynSizeFormat ", expected " dynSizeFormat, dbCount(a), countA);
+    if(dbAndCount(a, b) != both)
+        testFail("dbAndCount is " dynSizeFormat ", expected " dynSizeFormat, dbAndCount(a, b), both);
+
+    expected = 0;
+    for(index = dbNextSet(a, 0); index != -1; index = dbNextSet(a, index + 1))
+    {
+        if(!inA[index])
+            testFail("dbNextSet found unset bit " dynSizeFormat, index);
+        ++expected;
+    }
+    if(expected != countA)
+        testFail("dbNextSet visited " dynSizeFormat " bits", expected);
+
+    dbOr(c, a);
+    dbAnd(c, b); // bits past b's length get cleared
+    if(dbCount(c) != both)
+        testFail("dbAnd is wrong");
+    dbClearAll(c);
+    dbOr(c, a);
+    dbAndNot(c, b);
+    for(i = 0; i < BITS_COUNT; ++i)
+    {
+        if(dbTest(c, i) != (inA[i] && !inB[i]))
+            testFail("dbAndNot is wrong at %d", i);
+    }
+    dbXor(c, a);
+    if(dbAndCount(c, a) != both)
+        testFail("dbXor is wrong");
+
+    dbSetAll(b);
+    dbOr(b, a); // a is longer; b stays the same length
+    if(dbCount(b) != (BITS_COUNT - 200))
+        testFail("dbSetAll/dbOr leaked bits past the end");
+    dbResize(b, BITS_COUNT);
+    if(dbTest(b, BITS_COUNT - 100) || (dbCount(b) != (BITS_COUNT - 200)))
+        testFail("dbResize should clear new bits");
+    dbReset(b, 0);
+    if(dbTest(b, 0))
+        testFail("dbReset didn't");
+
+    dbDestroy(a);
+    dbDestroy(b);
+    dbDestroy(c);
+}
+
+// ------------------------------------------------------------------------------------------------
+// dynPackedArray Tests
+
+#define PACKED_COUNT 1000
+
+void test_dzPacked()
+{
+    dynPackedArray *sorted = dzCreate(DZF_DELTA);
+    dynPackedArray *wide = dzCreate(0);
+    dynPackedIter iter;
+    dynU32 expected[PACKED_COUNT];
+    dynU32 *decoded = NULL;
+    dynU32 value = 0, v;
+    dynSize count;
+    int i;
+
+    for(i = 0; i < PACKED_COUNT; ++i)
+    {
+        value += testRandom() % 50;
+        expected[i] = value;
+        dzAppend(sorted, value);
+    }
+    printf("packed %d sorted values into " dynSizeFormat " bytes\n", PACKED_COUNT, dzBytes(sorted));
+    if(dzSize(sorted) != PACKED_COUNT)
+        testFail("dzSize is " dynSizeFormat, dzSize(sorted));
+    if(dzBytes(sorted) >= (dynSize)(PACKED_COUNT * sizeof(dynU32) / 2))
+        testFail("delta packing should be much smaller than the raw values");
+
+    count = 0;
+    dzIterBegin(&iter, sorted);
+    while(dzIterNext(&iter, &v))
+    {
+        if((count >= PACKED_COUNT) || (v != expected[count]))
+            testFail("dzIterNext is wrong at " dynSizeFormat, count);
+        ++count;
+    }
+    if(count != PACKED_COUNT)
+        testFail("dzIterNext stopped after " dynSizeFormat, count);
+
+    // Full 32 bit values (and a zero run) without deltas
+    for(i = 0; i < PACKED_COUNT; ++i)
+        expected[i] = (i < 300) ? 0 : (dynU32)(testRandom() * 2654435761U);
+    dzAppendN(wide, expected, 500);
+    dzAppendN(wide, expected + 500, PACKED_COUNT - 500);
+    dzDecode(wide, &decoded);
+    if(daSize(&decoded) != PACKED_COUNT)
+        testFail("dzDecode gave " dynSizeFormat " values", daSize(&decoded));
+    for(i = 0; i < PACKED_COUNT; ++i)
+    {
+        if(decoded[i] != expected[i])
+            testFail("dzDecode is wrong at %d", i);
+    }
+
+    dzClear(wide);
+    dzDecode(wide, &decoded);
+    if((dzSize(wide) != 0) || (daSize(&decoded) != 0))
+        testFail("dzClear didn't empty the array");
+    daDestroy(&decoded, NULL);
+    dzDestroy(sorted);
+    dzDestroy(wide);
+}
+
 // ------------------------------------------------------------------------------------------------
 // dynString Tests
 
@@ -527,6 +1985,95 @@ void test_dsSetCapacity()
     dsDestroy(&str);
 }
 
+void test_dsReserve()
+{
+    char *str = NULL;
+    char *prev;
+    dynSize capacity;
+    int i, reallocs = 0;
+
+    for(i = 0; i < 10000; ++i)
+    {
+        prev = str;
+        capacity = dsCapacity(&str);
+        dsConcat(&str, "0123456789");
+        if((prev != str) || (capacity != dsCapacity(&str)))
+            ++reallocs;
+    }
+    printf("10000 appends: length " dynSizeFormat ", capacity " dynSizeFormat ", %d reallocs\n", dsLength(&str), dsCapacity(&str), reallocs);
+    if((dsLength(&str) != 100000) || (str[99999] != '9') || (str[100000] != 0))
+        testFail("dsConcat loop built the wrong string");
+    if(reallocs > 20)
+        testFail("dsConcat grew capacity %d times", reallocs);
+
+    dsShrinkToFit(&str);
+    if((dsCapacity(&str) != 100000) || (str[0] != '0') || (str[99999] != '9'))
+        testFail("dsShrinkToFit: capacity " dynSizeFormat, dsCapacity(&str));
+    dsReserve(&str, 10);
+    if(dsCapacity(&str) != 100000)
+        testFail("dsReserve shrank the string");
+    dsDestroy(&str);
+
+    dsReserve(&str, 64);
+    prev = str;
+    for(i = 0; i < 64; ++i)
+        dsConcat(&str, "x");
+    if((prev != str) || (dsCapacity(&str) != 64) || (dsLength(&str) != 64))
+        testFail("dsReserve didn't make room up front");
+    dsDestroy(&str);
+    dsShrinkToFit(&str); // no-op on a NULL string
+}
+
+void test_dsCompact()
+{
+    char storage[dynStringStorageSize(23)];
+    char *str = NULL;
+    char *empty = NULL;
+    int i;
+
+    dsCreate(&str);
+    dsCreate(&empty);
+    if((str != empty) || (dsLength(&str) != 0) || (dsCapacity(&str) != 0) || (str[0] != 0))
+        testFail("dsCreate didn't hand out the shared empty string");
+    dsClear(&str);
+    dsCopy(&str, "");
+    dsConcatf(&str, "%s", "");
+    if(str != empty)
+        testFail("empty operations allocated");
+    dsDestroy(&empty);
+
+    // grow across every header width and back down, checking the text survives each move
+    for(i = 0; i < 70000; ++i)
+        dsConcatLen(&str, &"abcdefghijklmnopqrstuvwxyz"[i % 26], 1);
+    if((dsLength(&str) != 70000) || (str[255] != 'v') || (str[65535] != 'p') || (str[69999] != 'h'))
+        testFail("dsConcat across header widths: length " dynSizeFormat, dsLength(&str));
+    dsSetCapacity(&str, 300);
+    if((dsLength(&str) != 300) || (dsCapacity(&str) != 300) || (str[299] != 'n') || (str[300] != 0))
+        testFail("dsSetCapacity 70000 -> 300 lost the text");
+    dsSetCapacity(&str, 10);
+    if((dsLength(&str) != 10) || (dsCapacity(&str) != 10) || strcmp(str, "abcdefghij"))
+        testFail("dsSetCapacity 300 -> 10 lost the text");
+    dsDestroy(&str);
+
+    dsCreateWithStorage(&str, storage, sizeof(storage));
+    if((dsCapacity(&str) != 23) || (str < storage) || (str >= (storage + sizeof(storage))))
+        testFail("dsCreateWithStorage: capacity " dynSizeFormat, dsCapacity(&str));
+    dsPrintf(&str, "%s %d", "fits in the buffer", 12345); // 24 chars: one too many
+    if(((str >= storage) && (str < (storage + sizeof(storage)))) || strcmp(str, "fits in the buffer 12345"))
+        testFail("dsCreateWithStorage never spilled");
+    dsDestroy(&str);
+
+    dsCreateWithStorage(&str, storage, sizeof(storage));
+    dsCopy(&str, "fits in the buffer 1234");
+    if((str < storage) || (str >= (storage + sizeof(storage))) || (dsLength(&str) != 23))
+        testFail("dsCreateWithStorage spilled early");
+    dsSetCapacity(&str, 4);
+    dsShrinkToFit(&str);
+    if((str < storage) || (str >= (storage + sizeof(storage))) || strcmp(str, "fits"))
+        testFail("shrinking a storage-backed string left its storage");
+    dsDestroy(&str); // nothing to free
+}
+
 // ------------------------------------------------------------------------------------------------
 // dynMap Tests
 
@@ -556,17 +2103,17 @@ void test_dmGetI()
 {
     dynMap *dm = dmCreate(DKF_INTEGER, 0);
     int i;
-    printf("count: %d, mod: %d, split: %d, width: %d, capacity: %d\n", dm->count, dm->mod, dm->split, daSize(&dm->table), daCapacity(&dm->table));
+    printf("count: " dynSizeFormat ", mod: " dynSizeFormat ", split: " dynSizeFormat ", width: " dynSizeFormat ", capacity: " dynSizeFormat "\n", dm->count, dm->mod, dm->split, daSize(&dm->table), daCapacity(&dm->table));
     for(i = 0; i < GETI_COUNT; ++i)
     {
         dmGetI2I(dm, i * 16) = i * 10;
     }
-    printf("count: %d, mod: %d, split: %d, width: %d, capacity: %d\n", dm->count, dm->mod, dm->split, daSize(&dm->table), daCapacity(&dm->table));
+    printf("count: " dynSizeFormat ", mod: " dynSizeFormat ", split: " dynSizeFormat ", width: " dynSizeFormat ", capacity: " dynSizeFormat "\n", dm->count, dm->mod, dm->split, daSize(&dm->table), daCapacity(&dm->table));
     for(i = 0; i < GETI_COUNT; ++i)
     {
         dmEraseInteger(dm, i * 16, NULL);
     }
-    printf("count: %d, mod: %d, split: %d, width: %d, capacity: %d\n", dm->count, dm->mod, dm->split, daSize(&dm->table), daCapacity(&dm->table));
+    printf("count: " dynSizeFormat ", mod: " dynSizeFormat ", split: " dynSizeFormat ", width: " dynSizeFormat ", capacity: " dynSizeFormat "\n", dm->count, dm->mod, dm->split, daSize(&dm->table), daCapacity(&dm->table));
     dmDestroy(dm, NULL);
 }
 
@@ -596,6 +2143,238 @@ void test_dmCustom()
     dmDestroy(dm, NULL); // CustomStruct is freed along with the entry
 }
 
+#define COMPACT_COUNT 10000
+static int verifyCompactedMap(dynMap *dm, int first, int last)
+{
+    char key[32];
+    int i;
+    for(i = first; i < last; ++i)
+    {
+        sprintf(key, "key%d", i);
+        if(!dmHasS(dm, key) || (dmGetS2I(dm, key) != i))
+            return 0;
+    }
+    return 1;
+}
+
+static int collectSlabbedKey(dynMap *dm, dynMapEntry *e, void *userData)
+{
+    if(e->slab)
+        daPush((dynInt **)userData, e->keyInt);
+    return 1;
+}
+
+void test_dmCompact()
+{
+    dynMap *dm = dmCreate(DKF_STRING, 0);
+    dynInt *slabbed = NULL;
+    char key[32];
+    int steps = 0;
+    int i;
+    for(i = 0; i < COMPACT_COUNT; ++i)
+    {
+        sprintf(key, "key%d", i);
+        dmGetS2I(dm, key) = i;
+    }
+
+    dmCompact(dm);
+    printf("slabs after dmCompact: " dynSizeFormat "\n", daSize(&dm->slabs));
+    if(daSize(&dm->slabs) != 1)
+        testFail("dmCompact should have used a single slab");
+    if(!verifyCompactedMap(dm, 0, COMPACT_COUNT))
+        testFail("dmCompact lost or damaged entries");
+
+    // Churn the map between incremental steps
+    for(i = 0; i < COMPACT_COUNT / 2; ++i)
+    {
+        sprintf(key, "key%d", i);
+        dmEraseString(dm, key, NULL);
+    }
+    for(i = COMPACT_COUNT; i < COMPACT_COUNT * 2; ++i)
+    {
+        sprintf(key, "key%d", i);
+        dmGetS2I(dm, key) = i;
+        if((i % 100) == 0)
+            dmCompactStep(dm, 500);
+    }
+    while(!dmCompactStep(dm, 500))
+        ++steps;
+    printf("incremental steps: %d, slabs: " dynSizeFormat "\n", steps, daSize(&dm->slabs));
+    if(!verifyCompactedMap(dm, COMPACT_COUNT / 2, COMPACT_COUNT * 2))
+        testFail("dmCompactStep lost or damaged entries");
+    if(dm->count != (COMPACT_COUNT * 3) / 2)
+        testFail("dmCompactStep changed the entry count");
+
+    // A full pass empties every older slab, which must be retired from the front
+    dmCompact(dm);
+    if((daSize(&dm->slabs) != 1) || !verifyCompactedMap(dm, COMPACT_COUNT / 2, COMPACT_COUNT * 2))
+        testFail("second dmCompact left " dynSizeFormat " slabs", daSize(&dm->slabs));
+    for(i = COMPACT_COUNT / 2; i < COMPACT_COUNT * 2; ++i)
+    {
+        sprintf(key, "key%d", i);
+        dmEraseString(dm, key, NULL);
+    }
+    if(daSize(&dm->slabs) != 0)
+        testFail("erasing every slabbed entry left " dynSizeFormat " slabs", daSize(&dm->slabs));
+
+    dmClear(dm, NULL);
+    dmGetS2I(dm, "after") = 1;
+    dmCompact(dm);
+    if(dmGetS2I(dm, "after") != 1)
+        testFail("dmCompact failed after dmClear");
+    dmDestroy(dm, NULL);
+
+    // Erasing everything a pass has moved so far retires every slab mid-pass
+    dm = dmCreate(DKF_INTEGER, 0);
+    for(i = 0; i < COMPACT_COUNT; ++i)
+        dmGetI2I(dm, i) = i;
+    dmCompactStep(dm, 10);
+    daCreate(&slabbed, sizeof(dynInt));
+    dmIterate(dm, collectSlabbedKey, &slabbed);
+    for(i = 0; i < (int)daSize(&slabbed); ++i)
+        dmEraseInteger(dm, slabbed[i], NULL);
+    if(!daSize(&slabbed) || (daSize(&dm->slabs) != 0))
+        testFail("erasing the relocated entries left " dynSizeFormat " slabs", daSize(&dm->slabs));
+    while(!dmCompactStep(dm, 10))
+        ;
+    for(i = 0; i < COMPACT_COUNT; ++i)
+    {
+        if(dmHasInteger(dm, i) && (dmGetI2I(dm, i) != i))
+            break;
+    }
+    if((i != COMPACT_COUNT) || (dm->count != (COMPACT_COUNT - daSize(&slabbed))))
+        testFail("dmCompactStep went wrong after its slabs emptied mid-pass");
+
+    // dmClear resets the count, which sizes the next pass's first slab
+    for(i = 0; i < COMPACT_COUNT * 10; ++i)
+        dmGetI2I(dm, i) = i;
+    dmClear(dm, NULL);
+    for(i = 0; i < 10; ++i)
+        dmGetI2I(dm, i) = i;
+    dmCompactStep(dm, 1);
+    if(dm->count != 10)
+        testFail("dmClear left a count of " dynSizeFormat, dm->count);
+    daDestroy(&slabbed, NULL);
+    dmDestroy(dm, NULL);
+}
+
+static void countBuiltKey(dynMapEntry *e, dynSize keyIndex, void *userData)
+{
+    dmEntryDefaultData(e)->valueInt++;
+}
+
+#define PARALLEL_BUILD_COUNT 100000
+void test_dmParallelBuild()
+{
+    static const char *strKeys[] = { "Foo", "Bar", "Baz", "Foo", "Qux", "Bar", "Foo" };
+    dynInt *keys = NULL;
+    dynMap *dm;
+    int i;
+
+    daCreate(&keys, sizeof(dynInt));
+    for(i = 0; i < PARALLEL_BUILD_COUNT; ++i)
+    {
+        daPushU32(&keys, (dynU32)(i % (PARALLEL_BUILD_COUNT / 2)));
+    }
+    dm = dmParallelBuild(DKF_INTEGER, 0, keys, daSize(&keys), countBuiltKey, NULL, 4);
+    printf("count: " dynSizeFormat ", mod: " dynSizeFormat ", split: " dynSizeFormat ", width: " dynSizeFormat "\n", dm->count, dm->mod, dm->split, daSize(&dm->table));
+    if(dm->count != PARALLEL_BUILD_COUNT / 2)
+        testFail("dmParallelBuild built " dynSizeFormat " entries, expected %d", dm->count, PARALLEL_BUILD_COUNT / 2);
+    for(i = 0; i < PARALLEL_BUILD_COUNT / 2; ++i)
+    {
+        if(!dmHasI(dm, i) || (dmGetI2I(dm, i) != 2))
+        {
+            testFail("dmParallelBuild key %d is missing or was built the wrong number of times", i);
+            break;
+        }
+    }
+    for(i = 0; i < PARALLEL_BUILD_COUNT / 2; ++i)
+    {
+        dmEraseInteger(dm, i, NULL);
+    }
+    if(dm->count != 0)
+        testFail("dmParallelBuild map did not erase cleanly");
+    dmDestroy(dm, NULL);
+    daDestroy(&keys, NULL);
+
+    dm = dmParallelBuild(DKF_STRING, 0, strKeys, 7, countBuiltKey, NULL, 3);
+    printf("Foo: %d, Bar: %d, Baz: %d, Qux: %d\n", dmGetS2I(dm, "Foo"), dmGetS2I(dm, "Bar"), dmGetS2I(dm, "Baz"), dmGetS2I(dm, "Qux"));
+    if((dm->count != 4) || (dmGetS2I(dm, "Foo") != 3) || (dmGetS2I(dm, "Bar") != 2) || (dmGetS2I(dm, "Qux") != 1))
+        testFail("dmParallelBuild string counts are wrong");
+    dmDestroy(dm, NULL);
+}
+
+static void sumMergedInts(dynMap *dst, dynMapEntry *dstEntry, dynMapEntry *srcEntry, void *userData)
+{
+    dmEntryDefaultData(dstEntry)->valueInt += dmEntryDefaultData(srcEntry)->valueInt;
+}
+
+void test_dmMerge()
+{
+    dynMap *a = dmCreate(DKF_STRING, 0);
+    dynMap *b = dmCreate(DKF_STRING, 0);
+    dmGetS2I(a, "Foo") = 1;
+    dmGetS2I(a, "Bar") = 2;
+    dmGetS2I(b, "Bar") = 20;
+    dmGetS2I(b, "Baz") = 30;
+    dmMerge(a, b, sumMergedInts, NULL);
+    printf("Foo: %d, Bar: %d, Baz: %d\n", dmGetS2I(a, "Foo"), dmGetS2I(a, "Bar"), dmGetS2I(a, "Baz"));
+    if((a->count != 3) || (dmGetS2I(a, "Foo") != 1) || (dmGetS2I(a, "Bar") != 22) || (dmGetS2I(a, "Baz") != 30))
+        testFail("dmMerge produced the wrong values");
+    if(b->count != 2)
+        testFail("dmMerge modified its source map");
+    dmDestroy(a, NULL);
+    dmDestroy(b, NULL);
+}
+
+typedef struct BatchValue
+{
+    int a;
+    int b;
+} BatchValue;
+
+static void checkBatchValues(void *elements, dynSize count)
+{
+    BatchValue **values = (BatchValue **)elements;
+    dynSize i;
+    ++batchCalls;
+    for(i = 0; i < count; ++i)
+        batchFreed += values[i]->a;
+}
+
+#define BATCH_COUNT 1000
+void test_dmBatch()
+{
+    dynMap *dm = dmCreate(DKF_INTEGER, 0);
+    int i;
+
+    for(i = 0; i < BATCH_COUNT; ++i)
+        dmGetI2P(dm, i) = createObject("batched");
+    batchCalls = batchFreed = 0;
+    dmClearBatch(dm, destroyObjectBatch);
+    if((batchFreed != BATCH_COUNT) || (batchCalls != ((BATCH_COUNT + DM_DESTROY_BATCH - 1) / DM_DESTROY_BATCH)))
+        testFail("dmClearBatch: %d calls, %d freed", batchCalls, batchFreed);
+    if(dmHasI(dm, 5))
+        testFail("dmClearBatch left entries behind");
+    dmGetI2P(dm, 5) = createObject("batched");
+    batchCalls = batchFreed = 0;
+    dmDestroyBatch(dm, destroyObjectBatch);
+    if((batchCalls != 1) || (batchFreed != 1))
+        testFail("dmDestroyBatch: %d calls, %d freed", batchCalls, batchFreed);
+
+    dm = dmCreate(DKF_STRING, sizeof(BatchValue));
+    for(i = 0; i < 10; ++i)
+    {
+        char key[16];
+        sprintf(key, "key%d", i);
+        dmGetS2T(dm, BatchValue, key)->a = i;
+    }
+    batchCalls = batchFreed = 0;
+    dmDestroyBatchIndirect(dm, checkBatchValues);
+    if((batchCalls != 1) || (batchFreed != 45))
+        testFail("dmDestroyBatchIndirect: %d calls, sum %d", batchCalls, batchFreed);
+}
+
 // ------------------------------------------------------------------------------------------------
 // "Harness"
 
@@ -634,10 +2413,32 @@ int main(int argc, char **argv)
 //    TEST(daSetCapacityP1);
     TEST(daCapacity);
     TEST(daSquash);
+    TEST(daPrune);
+    TEST(daStorage);
+    TEST(daClone);
+    TEST(daFile);
+    TEST(daGrowth);
+    TEST(daBatch);
+    TEST(daDeque);
+    TEST(daRange);
+    TEST(daUninit);
+    TEST(daInline);
+    TEST(daSort);
+    TEST(daHeap);
+    TEST(daSimd);
+    TEST(daParallel);
+    TEST(dqQueue);
     TEST(da8);
     TEST(da32);
     TEST(daStruct);
 
+    TEST(dcChunk);
+    TEST(drRecords);
+    TEST(dhSlotMap);
+    TEST(dpPool);
+    TEST(dbBits);
+    TEST(dzPacked);
+
     TEST(dsCreate);
     TEST(dsClear);
     TEST(dsCopy);
@@ -645,10 +2446,16 @@ int main(int argc, char **argv)
     TEST(dsSetLength);
     TEST(dsCalcLength);
     TEST(dsSetCapacity);
+    TEST(dsReserve);
+    TEST(dsCompact);
 
     TEST(dmGetS);
     TEST(dmGetI);
     TEST(dmCustom);
+    TEST(dmCompact);
+    TEST(dmParallelBuild);
+    TEST(dmMerge);
+    TEST(dmBatch);
 
     printf("\nTotal errors: %d\n\n", totalErrors);
     return 0;